@@ -0,0 +1,311 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Compares the structural-hashing implementation of RemoveEqualSubtrees and Forest2Dag with the
+// previous string-based one (reproduced below), on the optimal decision tree and on the forests
+// (main and end forests of every line forest) generated from the rule sets of the built algorithms.
+// Results of the two implementations are checked to be the same DRAG. Usage:
+//
+//     EqualSubtrees [repetitions] [rule set ...]
+//
+// where rule set is one of Rosenfeld, Rosenfeld3D, Grana, ZangSuen, GuoHall, ChenHsu, Erosion,
+// Dilation, ChainCode (all of them by default).
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "graphgen.h"
+
+#include "grana_ruleset.h"
+#include "rosenfeld_ruleset.h"
+#include "rosenfeld3d_ruleset.h"
+#include "chenhsu_ruleset.h"
+#include "guohall_ruleset.h"
+#include "zangsuen_ruleset.h"
+#include "erosion_ruleset.h"
+#include "dilation_ruleset.h"
+#include "chaincode_ruleset.h"
+
+using namespace std;
+
+// Previous implementation of RemoveEqualSubtrees, which identifies subtrees with their serialization
+struct StringRemoveEqualSubtrees {
+    unordered_map<string, BinaryDrag<conact>::node*> sp_; // string -> pointer
+    unordered_map<BinaryDrag<conact>::node*, string> ps_; // pointer -> string
+    uint nodes_ = 0, leaves_ = 0;
+
+    StringRemoveEqualSubtrees(BinaryDrag<conact>& bd) {
+        for (auto& t : bd.roots_) {
+            RemoveEqualSubtreesRec(t);
+        }
+    }
+
+    string RemoveEqualSubtreesRec(BinaryDrag<conact>::node*& n)
+    {
+        auto itps = ps_.find(n);
+        if (itps != end(ps_)) {
+            return itps->second;
+        }
+
+        string s;
+        if (n->isleaf()) {
+            ++leaves_;
+            const vector<uint>& a = n->data.actions();
+            s = '.' + to_string(a[0]);
+            for (size_t i = 1; i < a.size(); ++i) {
+                s += ',' + to_string(a[i]);
+            }
+            s += '-' + to_string(n->data.next);
+        }
+        else {
+            ++nodes_;
+            auto sl = RemoveEqualSubtreesRec(n->left);
+            auto sr = RemoveEqualSubtreesRec(n->right);
+            s = n->data.condition + sl + sr;
+        }
+
+        auto it = sp_.find(s);
+        if (it == end(sp_)) {
+            sp_.insert({ s, n });
+            ps_.insert({ n, s });
+        }
+        else {
+            n = it->second;
+            if (n->isleaf()) {
+                --leaves_;
+            }
+            else {
+                --nodes_;
+            }
+        }
+        return s;
+    }
+};
+
+// Previous implementation of Forest2Dag
+struct StringForest2Dag {
+    unordered_map<BinaryDrag<conact>::node*, string> ps_; // pointer -> string
+    unordered_map<string, BinaryDrag<conact>::node*> sp_; // string -> pointer
+
+    string Tree2String(BinaryDrag<conact>::node* n) {
+        auto it = ps_.find(n);
+        if (it != end(ps_))
+            return it->second;
+
+        string s;
+        if (n->isleaf()) {
+            stringstream ss;
+            ss << setfill('0') << setw(3) << n->data.next;
+            s = n->data.action.to_string() + ss.str();
+        }
+        else
+            s = n->data.condition + Tree2String(n->left) + Tree2String(n->right);
+
+        ps_[n] = s;
+        return s;
+    }
+
+    void FindAndLink(BinaryDrag<conact>::node* n) {
+        if (!n->isleaf()) {
+            for (auto child : { &n->left, &n->right }) {
+                auto s = Tree2String(*child);
+                auto it = sp_.find(s);
+                if (it == end(sp_)) {
+                    sp_[s] = *child;
+                    FindAndLink(*child);
+                }
+                else {
+                    *child = it->second;
+                }
+            }
+        }
+    }
+
+    StringForest2Dag(LineForestHandler& f) {
+        for (auto& t : f.f_.roots_) {
+            FindAndLink(t);
+        }
+        for (auto& ef : f.end_forests_) {
+            ps_.clear();
+            sp_.clear();
+            for (auto& et : ef.roots_) {
+                FindAndLink(et);
+            }
+        }
+    }
+};
+
+// Serializes the structure of a DRAG, numbering nodes in order of first visit, so that two DRAGs have
+// the same signature if and only if they are equal and share the same nodes.
+static string Signature(const BinaryDrag<conact>& bd) {
+    unordered_map<const BinaryDrag<conact>::node*, size_t> ids;
+    ostringstream os;
+    function<size_t(const BinaryDrag<conact>::node*)> SignatureRec = [&](const BinaryDrag<conact>::node* n) -> size_t {
+        auto it = ids.find(n);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        size_t l = 0, r = 0;
+        if (!n->isleaf()) {
+            l = SignatureRec(n->left);
+            r = SignatureRec(n->right);
+        }
+        size_t id = ids.size() + 1;
+        ids[n] = id;
+        if (n->isleaf()) {
+            os << id << ":" << n->data.action.to_string() << "-" << n->data.next << ";";
+        }
+        else {
+            os << id << ":" << n->data.condition << "(" << l << "," << r << ");";
+        }
+        return id;
+    };
+    for (const auto& r : bd.roots_) {
+        os << "r" << SignatureRec(r) << ";";
+    }
+    return os.str();
+}
+
+struct Timing {
+    double string_ms = 0;
+    double structural_ms = 0;
+    size_t nodes = 0;
+    size_t reduced_nodes = 0;
+    bool same = true;
+};
+
+// Runs f on a fresh copy of obj for every repetition and returns the total time spent in f
+template <typename T, typename F>
+static double Measure(const T& obj, size_t repetitions, F f, T& result) {
+    double ms = 0;
+    for (size_t r = 0; r < repetitions; ++r) {
+        T copy(obj);
+        auto start = chrono::steady_clock::now();
+        f(copy);
+        ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (r + 1 == repetitions) {
+            result = move(copy);
+        }
+    }
+    return ms;
+}
+
+static size_t CountNodes(const BinaryDrag<conact>& bd) {
+    unordered_set<const BinaryDrag<conact>::node*> visited;
+    function<void(const BinaryDrag<conact>::node*)> CountRec = [&](const BinaryDrag<conact>::node* n) {
+        if (n != nullptr && visited.insert(n).second) {
+            CountRec(n->left);
+            CountRec(n->right);
+        }
+    };
+    for (const auto& r : bd.roots_) {
+        CountRec(r);
+    }
+    return visited.size();
+}
+
+static void RemoveEqualSubtreesBoth(const BinaryDrag<conact>& bd, size_t repetitions, Timing& t) {
+    BinaryDrag<conact> a, b;
+    t.string_ms += Measure(bd, repetitions, [](BinaryDrag<conact>& x) { StringRemoveEqualSubtrees{ x }; }, a);
+    t.structural_ms += Measure(bd, repetitions, [](BinaryDrag<conact>& x) { RemoveEqualSubtrees{ x }; }, b);
+    t.nodes += CountNodes(bd);
+    t.reduced_nodes += CountNodes(b);
+    t.same = t.same && Signature(a) == Signature(b);
+}
+
+static void Forest2DagBoth(const LineForestHandler& lfh, size_t repetitions, Timing& t) {
+    LineForestHandler a, b;
+    t.string_ms += Measure(lfh, repetitions, [](LineForestHandler& x) { StringForest2Dag{ x }; }, a);
+    t.structural_ms += Measure(lfh, repetitions, [](LineForestHandler& x) { Forest2Dag{ x }; }, b);
+    t.nodes += CountNodes(lfh.f_);
+    t.reduced_nodes += CountNodes(b.f_);
+    t.same = t.same && Signature(a.f_) == Signature(b.f_);
+    for (size_t i = 0; i < lfh.end_forests_.size(); ++i) {
+        t.nodes += CountNodes(lfh.end_forests_[i]);
+        t.reduced_nodes += CountNodes(b.end_forests_[i]);
+        t.same = t.same && Signature(a.end_forests_[i]) == Signature(b.end_forests_[i]);
+    }
+}
+
+static bool GetRuleSet(const string& name, rule_set& rs) {
+    if (name == "Rosenfeld") rs = RosenfeldRS().GetRuleSet();
+    else if (name == "Rosenfeld3D") rs = Rosenfeld3dRS().GetRuleSet();
+    else if (name == "Grana") rs = GranaRS().GetRuleSet();
+    else if (name == "ZangSuen") rs = ZangSuenRS().GetRuleSet();
+    else if (name == "GuoHall") rs = GuoHallRS().GetRuleSet();
+    else if (name == "ChenHsu") rs = ChenHsuRS().GetRuleSet();
+    else if (name == "Erosion") rs = ErosionRS().GetRuleSet();
+    else if (name == "Dilation") rs = DilationRS().GetRuleSet();
+    else if (name == "ChainCode") rs = ChainCodeRS().GetRuleSet();
+    else return false;
+    return true;
+}
+
+static void PrintRow(const string& rs_name, const string& what, const Timing& t) {
+    cout << left << setw(12) << rs_name << setw(22) << what << right << setw(10) << t.nodes << setw(10) << t.reduced_nodes
+        << fixed << setprecision(2) << setw(14) << t.string_ms << setw(14) << t.structural_ms
+        << setw(10) << (t.structural_ms > 0 ? t.string_ms / t.structural_ms : 0) << setw(8) << (t.same ? "yes" : "NO") << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+    size_t repetitions = argc > 1 ? stoul(argv[1]) : 10;
+    vector<string> names(argv + min(argc, 2), argv + argc);
+    if (names.empty()) {
+        names = { "Rosenfeld", "Rosenfeld3D", "Grana", "ZangSuen", "GuoHall", "ChenHsu", "Erosion", "Dilation", "ChainCode" };
+    }
+
+    vector<tuple<string, string, Timing>> rows;
+    for (const auto& rs_name : names) {
+        string algorithm_name = "EqualSubtrees_" + rs_name;
+        conf = ConfigData(algorithm_name, rs_name);
+
+        rule_set rs;
+        if (!GetRuleSet(rs_name, rs)) {
+            cout << "WARNING: unknown rule set '" << rs_name << "', skipped.\n";
+            continue;
+        }
+
+        BinaryDrag<conact> bd = GetOdt(rs);
+        Timing odt;
+        RemoveEqualSubtreesBoth(bd, repetitions, odt);
+        rows.emplace_back(rs_name, "ODT", odt);
+
+        LOG(rs_name + " - making forests",
+            ForestHandler fh(bd, rs.ps_,
+                ForestHandlerFlags::CENTER_LINES |
+                ForestHandlerFlags::FIRST_LINE   |
+                ForestHandlerFlags::LAST_LINE    |
+                ForestHandlerFlags::SINGLE_LINE);
+        );
+
+        Timing forests, forest2dag;
+        for (const auto& [flag, lfh] : fh.f_) {
+            RemoveEqualSubtreesBoth(lfh.f_, repetitions, forests);
+            for (const auto& ef : lfh.end_forests_) {
+                RemoveEqualSubtreesBoth(ef, repetitions, forests);
+            }
+            Forest2DagBoth(lfh, repetitions, forest2dag);
+        }
+        rows.emplace_back(rs_name, "forests", forests);
+        rows.emplace_back(rs_name, "forests (Forest2Dag)", forest2dag);
+    }
+
+    cout << "\nTotal time of " << repetitions << " repetitions\n";
+    cout << left << setw(12) << "rule set" << setw(22) << "input" << right << setw(10) << "nodes" << setw(10) << "reduced"
+        << setw(14) << "string (ms)" << setw(14) << "struct (ms)" << setw(10) << "speedup" << setw(8) << "same" << "\n";
+    bool all_same = true;
+    for (const auto& [rs_name, what, t] : rows) {
+        PrintRow(rs_name, what, t);
+        all_same = all_same && t.same;
+    }
+
+    return all_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,223 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Microbenchmark of the hypercube combine kernels: every available kernel combines the same
+// random cells and the throughput (cells per second) is compared with the scalar one. Then, the
+// in-core hypercube of each rule set is optimized with every available kernel, checking that the
+// generated tree is the same as the one of the scalar kernel. Usage:
+//
+//     HyperCube_Kernel [cells] [repetitions] [rule set ...]
+//
+// where rule set is one of Rosenfeld, Rosenfeld3D, Grana, ZangSuen, GuoHall, ChenHsu (all of
+// them by default).
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "hypercube++.h"
+#include "hypercube_kernel.h"
+
+#include "grana_ruleset.h"
+#include "rosenfeld_ruleset.h"
+#include "rosenfeld3d_ruleset.h"
+#include "chenhsu_ruleset.h"
+#include "guohall_ruleset.h"
+#include "zangsuen_ruleset.h"
+
+using namespace std;
+using namespace hyper;
+
+template <typename ActionSet, typename Counter>
+struct Cells {
+    vector<ActionSet> actions0, actions1, actions;
+    vector<Counter> frequency0, frequency1, frequency, gain0, gain1, gain;
+    vector<uint8_t> max_gain_index;
+
+    Cells(size_t n, mt19937_64& rng) :
+        actions0(n), actions1(n), actions(n, 0),
+        frequency0(n), frequency1(n), frequency(n, 0), gain0(n), gain1(n), gain(n, 0),
+        max_gain_index(n, 0)
+    {
+        // Sparse actions, so that about half of the intersections are empty
+        uniform_int_distribution<int> bit(0, sizeof(ActionSet) * 8 - 1);
+        uniform_int_distribution<uint32_t> counter(0, 1 << 16);
+        for (size_t i = 0; i < n; ++i) {
+            actions0[i] = static_cast<ActionSet>(ActionSet(1) << bit(rng)) | static_cast<ActionSet>(ActionSet(1) << bit(rng));
+            actions1[i] = static_cast<ActionSet>(ActionSet(1) << bit(rng)) | static_cast<ActionSet>(ActionSet(1) << bit(rng));
+            frequency0[i] = counter(rng);
+            frequency1[i] = counter(rng);
+            gain0[i] = counter(rng);
+            gain1[i] = counter(rng);
+        }
+    }
+
+    CombineCells<ActionSet, Counter> Args(uint8_t index) {
+        return { actions.size(),
+            actions0.data(), actions1.data(), frequency0.data(), frequency1.data(), gain0.data(), gain1.data(),
+            index,
+            actions.data(), frequency.data(), gain.data(), max_gain_index.data() };
+    }
+
+    void Reset() {
+        fill(actions.begin(), actions.end(), ActionSet(0));
+        fill(frequency.begin(), frequency.end(), Counter(0));
+        fill(gain.begin(), gain.end(), Counter(0));
+        fill(max_gain_index.begin(), max_gain_index.end(), uint8_t(0));
+    }
+
+    bool operator==(const Cells& other) const {
+        return actions == other.actions && frequency == other.frequency && gain == other.gain && max_gain_index == other.max_gain_index;
+    }
+};
+
+template <typename ActionSet, typename Counter>
+void Benchmark(const string& name, size_t ncells, size_t repetitions) {
+    mt19937_64 rng(42);
+    Cells<ActionSet, Counter> reference(ncells, rng);
+    CombineKernel<ActionSet, Counter> scalar = GetCombineKernel<ActionSet, Counter>(KernelIsa::SCALAR);
+    for (uint8_t index = 0; index < 4; ++index) {
+        scalar(reference.Args(index));
+    }
+
+    double scalar_throughput = 0;
+    for (KernelIsa isa : { KernelIsa::SCALAR, KernelIsa::AVX2, KernelIsa::AVX512 }) {
+        if (isa > DetectKernelIsa()) {
+            continue;
+        }
+        CombineKernel<ActionSet, Counter> kernel = GetCombineKernel<ActionSet, Counter>(isa);
+        if (isa != KernelIsa::SCALAR && kernel == scalar) {
+            cout << left << setw(18) << name << setw(8) << KernelIsaName(isa) << "not available\n";
+            continue;
+        }
+
+        Cells<ActionSet, Counter> cells = reference;
+        double best_ms = numeric_limits<double>::max();
+        for (size_t r = 0; r < repetitions; ++r) {
+            cells.Reset();
+            auto start = chrono::steady_clock::now();
+            // Each node combines the children of several indifferences
+            for (uint8_t index = 0; index < 4; ++index) {
+                kernel(cells.Args(index));
+            }
+            auto stop = chrono::steady_clock::now();
+            best_ms = min(best_ms, chrono::duration<double, milli>(stop - start).count());
+        }
+
+        double throughput = 4.0 * ncells / (best_ms / 1000.0) / 1e6;
+        if (isa == KernelIsa::SCALAR) {
+            scalar_throughput = throughput;
+        }
+        cout << left << setw(18) << name << setw(8) << KernelIsaName(isa)
+            << right << fixed << setprecision(1) << setw(10) << throughput << " Mcells/s"
+            << setprecision(2) << setw(8) << throughput / scalar_throughput << "x"
+            << (cells == reference ? "" : "  RESULTS DIFFER FROM SCALAR") << "\n";
+    }
+}
+
+// Serialization of a tree, used to compare the trees generated with different kernels
+static void Signature(const BinaryDrag<conact>::node* n, ostream& os) {
+    if (n->isleaf()) {
+        os << '.' << n->data.action.to_string();
+    }
+    else {
+        os << '(' << n->data.condition;
+        Signature(n->left, os);
+        Signature(n->right, os);
+        os << ')';
+    }
+}
+
+static string Signature(const BinaryDrag<conact>& t) {
+    ostringstream os;
+    Signature(t.roots_[0], os);
+    return os.str();
+}
+
+static bool GetRuleSet(const string& name, rule_set& rs) {
+    if (name == "Rosenfeld") rs = RosenfeldRS().GetRuleSet();
+    else if (name == "Rosenfeld3D") rs = Rosenfeld3dRS().GetRuleSet();
+    else if (name == "Grana") rs = GranaRS().GetRuleSet();
+    else if (name == "ZangSuen") rs = ZangSuenRS().GetRuleSet();
+    else if (name == "GuoHall") rs = GuoHallRS().GetRuleSet();
+    else if (name == "ChenHsu") rs = ChenHsuRS().GetRuleSet();
+    else return false;
+    return true;
+}
+
+// Optimizes the in-core hypercube of the rule set with every available kernel. Returns false when
+// a tree is different from the one generated by the scalar kernel.
+static bool CompareHyperCube(const string& rs_name, const rule_set& rs) {
+    string reference;
+    double scalar_ms = 0;
+    bool same = true;
+    for (KernelIsa isa : { KernelIsa::SCALAR, KernelIsa::AVX2, KernelIsa::AVX512 }) {
+        if (isa > DetectKernelIsa()) {
+            continue;
+        }
+        auto start = chrono::steady_clock::now();
+        BinaryDrag<conact> t = hyper::GenerateOdt(rs, 1, isa);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        string signature = Signature(t);
+        if (isa == KernelIsa::SCALAR) {
+            reference = signature;
+            scalar_ms = ms;
+        }
+        bool same_tree = signature == reference;
+        same = same && same_tree;
+        cout << left << setw(18) << rs_name << setw(8) << KernelIsaName(isa)
+            << right << fixed << setprecision(1) << setw(10) << ms << " ms"
+            << setprecision(2) << setw(8) << scalar_ms / ms << "x"
+            << (same_tree ? "" : "  TREE DIFFERS FROM SCALAR") << "\n";
+    }
+    return same;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t ncells = 1 << 22;
+    size_t repetitions = 10;
+    if (argc > 1) {
+        ncells = stoull(argv[1]);
+    }
+    if (argc > 2) {
+        repetitions = stoull(argv[2]);
+    }
+
+    cout << "Combine kernels benchmark: " << ncells << " cells, best of " << repetitions << " repetitions\n";
+    cout << "Detected instruction set: " << KernelIsaName(DetectKernelIsa()) << "\n\n";
+
+    Benchmark<uint16_t, uint32_t>("uint16/uint32", ncells, repetitions);
+    Benchmark<uint32_t, uint32_t>("uint32/uint32", ncells, repetitions);
+    Benchmark<uint64_t, uint32_t>("uint64/uint32", ncells, repetitions);
+    Benchmark<uint16_t, uint64_t>("uint16/uint64", ncells, repetitions);
+    Benchmark<uint32_t, uint64_t>("uint32/uint64", ncells, repetitions);
+    Benchmark<uint64_t, uint64_t>("uint64/uint64", ncells, repetitions);
+
+    vector<string> names(argv + min(argc, 3), argv + argc);
+    if (names.empty()) {
+        names = { "Rosenfeld", "Rosenfeld3D", "Grana", "ZangSuen", "GuoHall", "ChenHsu" };
+    }
+
+    cout << "\nIn-core hypercube, single thread\n";
+    bool all_same = true;
+    for (const auto& rs_name : names) {
+        rule_set rs;
+        if (!GetRuleSet(rs_name, rs)) {
+            cout << "WARNING: unknown rule set '" << rs_name << "', skipped.\n";
+            continue;
+        }
+        all_same = CompareHyperCube(rs_name, rs) && all_same;
+    }
+
+    return all_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
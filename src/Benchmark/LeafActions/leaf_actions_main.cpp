@@ -0,0 +1,211 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Compares the bottom-up selection of the actions of leaves (Dag2OptimalDagBottomUp) with the brute-force
+// engines which enumerate all the combinations of actions (FindOptimalDrag and Dag2OptimalDag), on the
+// optimal decision trees of the rule sets used by the built algorithms and on their largest subtrees.
+// Brute-force engines only run on trees with at most max_combinations combinations, and their results
+// are checked to have the same number of nodes and leaves of the bottom-up one. Usage:
+//
+//     LeafActions [max_combinations] [rule set ...]
+//
+// where rule set is one of Rosenfeld, Rosenfeld3D, Grana, ZangSuen, GuoHall, ChenHsu, Erosion,
+// Dilation, ChainCode (all of them by default).
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "graphgen.h"
+
+#include "grana_ruleset.h"
+#include "rosenfeld_ruleset.h"
+#include "rosenfeld3d_ruleset.h"
+#include "chenhsu_ruleset.h"
+#include "guohall_ruleset.h"
+#include "zangsuen_ruleset.h"
+#include "erosion_ruleset.h"
+#include "dilation_ruleset.h"
+#include "chaincode_ruleset.h"
+
+using namespace std;
+
+// Number of subtrees of each optimal decision tree compared with the brute-force engines
+static constexpr size_t kSubtrees = 8;
+
+struct Result {
+    size_t nodes = 0;
+    size_t leaves = 0;
+    double ms = 0;
+    bool run = false;
+};
+
+struct Row {
+    string rs_name;
+    string what;
+    size_t ambiguous_leaves = 0;
+    double combinations = 1;
+    bool optimal = false;
+    Result bottom_up{}, find_optimal_drag{}, dag2optimal{};
+
+    bool same() const {
+        for (const auto& r : { find_optimal_drag, dag2optimal }) {
+            if (r.run && (r.nodes != bottom_up.nodes || r.leaves != bottom_up.leaves)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static bool GetRuleSet(const string& name, rule_set& rs) {
+    if (name == "Rosenfeld") rs = RosenfeldRS().GetRuleSet();
+    else if (name == "Rosenfeld3D") rs = Rosenfeld3dRS().GetRuleSet();
+    else if (name == "Grana") rs = GranaRS().GetRuleSet();
+    else if (name == "ZangSuen") rs = ZangSuenRS().GetRuleSet();
+    else if (name == "GuoHall") rs = GuoHallRS().GetRuleSet();
+    else if (name == "ChenHsu") rs = ChenHsuRS().GetRuleSet();
+    else if (name == "Erosion") rs = ErosionRS().GetRuleSet();
+    else if (name == "Dilation") rs = DilationRS().GetRuleSet();
+    else if (name == "ChainCode") rs = ChainCodeRS().GetRuleSet();
+    else return false;
+    return true;
+}
+
+// Copies the subtree rooted in n
+static BinaryDrag<conact> Subtree(BinaryDrag<conact>::node* n) {
+    BinaryDrag<conact> tmp;
+    tmp.roots_.push_back(n);
+    BinaryDrag<conact> t(tmp);
+    tmp.roots_.clear();
+    return t;
+}
+
+// Counts the leaves with multiple actions and the combinations of their actions
+static void CountCombinations(const BinaryDrag<conact>::node* n, size_t& ambiguous_leaves, double& combinations) {
+    if (n->isleaf()) {
+        size_t actions = n->data.action.count();
+        if (actions > 1) {
+            ++ambiguous_leaves;
+            combinations *= actions;
+        }
+        return;
+    }
+    CountCombinations(n->left, ambiguous_leaves, combinations);
+    CountCombinations(n->right, ambiguous_leaves, combinations);
+}
+
+template <typename F>
+static Result Measure(F f) {
+    Result r;
+    auto start = chrono::steady_clock::now();
+    BinaryDrag<conact> t = f();
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    BinaryDragStatistics bds(t);
+    r.nodes = bds.Nodes();
+    r.leaves = bds.Leaves();
+    r.run = true;
+    return r;
+}
+
+static Row Compare(const string& rs_name, const string& what, const BinaryDrag<conact>& t, double max_combinations) {
+    Row row{ rs_name, what };
+    CountCombinations(t.GetRoot(), row.ambiguous_leaves, row.combinations);
+
+    row.bottom_up = Measure([&] {
+        BinaryDrag<conact> x(t);
+        row.optimal = Dag2OptimalDagBottomUp(x);
+        return x;
+    });
+    if (row.combinations <= max_combinations) {
+        row.find_optimal_drag = Measure([&] {
+            FindOptimalDrag fod(t);
+            fod.GenerateAllTrees();
+            return fod.best_tree_;
+        });
+        row.dag2optimal = Measure([&] {
+            BinaryDrag<conact> x(t);
+            Dag2OptimalDag(x);
+            return x;
+        });
+    }
+    return row;
+}
+
+static void PrintResult(const Result& r) {
+    if (r.run) {
+        cout << setw(7) << r.nodes << setw(7) << r.leaves << setw(12) << r.ms;
+    }
+    else {
+        cout << setw(7) << "-" << setw(7) << "-" << setw(12) << "-";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    double max_combinations = argc > 1 ? stod(argv[1]) : 1e4;
+    vector<string> names(argv + min(argc, 2), argv + argc);
+    if (names.empty()) {
+        names = { "Rosenfeld", "Rosenfeld3D", "Grana", "ZangSuen", "GuoHall", "ChenHsu", "Erosion", "Dilation", "ChainCode" };
+    }
+
+    vector<Row> rows;
+    for (const auto& rs_name : names) {
+        string algorithm_name = "LeafActions_" + rs_name;
+        conf = ConfigData(algorithm_name, rs_name);
+
+        rule_set rs;
+        if (!GetRuleSet(rs_name, rs)) {
+            cout << "WARNING: unknown rule set '" << rs_name << "', skipped.\n";
+            continue;
+        }
+
+        BinaryDrag<conact> bd = GetOdt(rs);
+        rows.push_back(Compare(rs_name, "ODT", bd, max_combinations));
+
+        // The largest subtrees which can be checked with the brute-force engines
+        vector<pair<double, BinaryDrag<conact>::node*>> subtrees;
+        function<void(BinaryDrag<conact>::node*)> CollectRec = [&](BinaryDrag<conact>::node* n) {
+            if (n->isleaf()) {
+                return;
+            }
+            size_t ambiguous_leaves = 0;
+            double combinations = 1;
+            CountCombinations(n, ambiguous_leaves, combinations);
+            if (combinations > max_combinations) {
+                CollectRec(n->left);
+                CollectRec(n->right);
+            }
+            else if (n != bd.GetRoot() && combinations > 1) {
+                subtrees.emplace_back(combinations, n);
+            }
+        };
+        CollectRec(bd.GetRoot());
+        stable_sort(begin(subtrees), end(subtrees), [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (size_t i = 0; i < subtrees.size() && i < kSubtrees; ++i) {
+            rows.push_back(Compare(rs_name, "subtree " + to_string(i), Subtree(subtrees[i].second), max_combinations));
+        }
+    }
+
+    cout << "\n" << left << setw(12) << "rule set" << setw(12) << "input" << right << setw(8) << "leaves" << setw(12) << "combin."
+        << setw(26) << "bottom-up (nodes, leaves, ms)" << setw(9) << "optimal" << setw(26) << "FindOptimalDrag" << setw(26) << "Dag2OptimalDag"
+        << setw(6) << "same" << "\n";
+    bool all_same = true;
+    for (const auto& r : rows) {
+        cout << left << setw(12) << r.rs_name << setw(12) << r.what << right << setw(8) << r.ambiguous_leaves
+            << setw(12) << setprecision(3) << r.combinations << fixed << setprecision(2);
+        PrintResult(r.bottom_up);
+        cout << setw(9) << (r.optimal ? "yes" : "no");
+        PrintResult(r.find_optimal_drag);
+        PrintResult(r.dag2optimal);
+        cout << setw(6) << (r.same() ? "yes" : "NO") << defaultfloat << "\n";
+        all_same = all_same && r.same();
+    }
+
+    return all_same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
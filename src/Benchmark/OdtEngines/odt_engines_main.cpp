@@ -0,0 +1,218 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Runs every registered ODT engine on the same rule set and compares wall time, peak
+// resident memory and cost of the generated tree. Usage:
+//
+//     OdtEngines [rule set] [engine ...]
+//
+// where rule set is one of Rosenfeld, Rosenfeld3D, Grana, ZangSuen, GuoHall, ChenHsu (default
+// Grana) or the path of a rule set (.yaml) file. All the registered engines are run when no
+// engine is specified. Engine parameters (threads, out-of-core path) are read from config.yaml.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "graphgen.h"
+
+#include "grana_ruleset.h"
+#include "rosenfeld_ruleset.h"
+#include "rosenfeld3d_ruleset.h"
+#include "chenhsu_ruleset.h"
+#include "guohall_ruleset.h"
+#include "zangsuen_ruleset.h"
+
+#if defined(GRAPHGEN_WINDOWS)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+struct EngineResult {
+    double ms = 0;
+    double peak_rss_mb = 0;
+    unsigned long long cost = 0;
+    unsigned long long nodes = 0;
+    unsigned long long leaves = 0;
+    unsigned long long wrong_rules = 0;
+};
+
+// Number of conditions checked to classify every rule of the rule set, weighted by the rule
+// frequency, which is the quantity minimized by the hypercube. Rules whose leaf action is not
+// one of the rule actions are counted as wrong.
+static void TreeCost(const BinaryDrag<conact>& t, const rule_set& rs, EngineResult& r) {
+    for (size_t i = 0; i < rs.rules.size(); ++i) {
+        const BinaryDrag<conact>::node* n = t.roots_[0];
+        unsigned long long depth = 0;
+        while (n->isleaf() == false) {
+            ++depth;
+            n = ((i >> rs.conditions_pos.at(n->data.condition)) & 1) ? n->right : n->left;
+        }
+        r.cost += depth * rs.rules[i].frequency;
+        if ((n->data.action & rs.rules[i].actions).none()) {
+            ++r.wrong_rules;
+        }
+    }
+
+    vector<const BinaryDrag<conact>::node*> stack{ t.roots_[0] };
+    while (!stack.empty()) {
+        const BinaryDrag<conact>::node* n = stack.back();
+        stack.pop_back();
+        if (n->isleaf()) {
+            ++r.leaves;
+        }
+        else {
+            ++r.nodes;
+            stack.push_back(n->left);
+            stack.push_back(n->right);
+        }
+    }
+}
+
+static EngineResult RunEngine(const string& name, const rule_set& rs) {
+    EngineResult r;
+    auto engine = OdtEngineRegistry::Instance().Create(name);
+    auto start = chrono::steady_clock::now();
+    BinaryDrag<conact> t = engine->Generate(rs);
+    r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    TreeCost(t, rs, r);
+    return r;
+}
+
+#if defined(GRAPHGEN_WINDOWS)
+
+// Windows has no fork(), so engines run in this process and the reported value is the peak
+// working set of the process up to the end of the engine.
+static bool MeasureEngine(const string& name, const rule_set& rs, EngineResult& r) {
+    r = RunEngine(name, rs);
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        r.peak_rss_mb = pmc.PeakWorkingSetSize / double(1 << 20);
+    }
+    return true;
+}
+
+#else
+
+// Every engine runs in a child process, so that its peak resident memory can be measured
+// independently from the others. Results are sent back through a pipe.
+static bool MeasureEngine(const string& name, const rule_set& rs, EngineResult& r) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+        return false;
+    }
+    cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        close(fd[0]);
+        EngineResult child = RunEngine(name, rs);
+        cout.flush();
+        ssize_t written = write(fd[1], &child, sizeof(child));
+        close(fd[1]);
+        _exit(written == sizeof(child) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fd[1]);
+    ssize_t nread = read(fd[0], &r, sizeof(r));
+    close(fd[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0 || nread != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        return false;
+    }
+#if defined(GRAPHGEN_APPLE)
+    r.peak_rss_mb = usage.ru_maxrss / double(1 << 20); // bytes
+#else
+    r.peak_rss_mb = usage.ru_maxrss / double(1 << 10); // kilobytes
+#endif
+    return true;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+    string rs_name = argc > 1 ? argv[1] : "Grana";
+    vector<string> engines(argv + min(argc, 2), argv + argc);
+    if (engines.empty()) {
+        engines = OdtEngineRegistry::Instance().Names();
+    }
+
+    string algorithm_name = "OdtEngines_" + filesystem::path(rs_name).stem().string();
+    conf = ConfigData(algorithm_name, rs_name);
+
+    rule_set rs;
+    if (rs_name == "Rosenfeld") {
+        rs = RosenfeldRS().GetRuleSet();
+    }
+    else if (rs_name == "Rosenfeld3D") {
+        rs = Rosenfeld3dRS().GetRuleSet();
+    }
+    else if (rs_name == "Grana") {
+        rs = GranaRS().GetRuleSet();
+    }
+    else if (rs_name == "ZangSuen") {
+        rs = ZangSuenRS().GetRuleSet();
+    }
+    else if (rs_name == "GuoHall") {
+        rs = GuoHallRS().GetRuleSet();
+    }
+    else if (rs_name == "ChenHsu") {
+        rs = ChenHsuRS().GetRuleSet();
+    }
+    else {
+        try {
+            YAML::Node node = YAML::LoadFile(rs_name);
+            rs = rule_set(node);
+        }
+        catch (...) {
+            cout << "ERROR: unknown rule set '" << rs_name << "'.\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    vector<pair<string, EngineResult>> results;
+    for (const auto& name : engines) {
+        if (!OdtEngineRegistry::Instance().Create(name)) {
+            cout << "WARNING: unknown ODT engine '" << name << "', skipped.\n";
+            continue;
+        }
+        cout << "Engine '" << name << "' (" << OdtEngineRegistry::Instance().Description(name) << ")\n";
+        EngineResult r;
+        if (!MeasureEngine(name, rs, r)) {
+            cout << "ERROR: engine '" << name << "' failed.\n";
+            continue;
+        }
+        cout << "\n";
+        results.emplace_back(name, r);
+    }
+
+    cout << "\nRule set " << rs_name << ": " << rs.conditions.size() << " conditions, " << rs.actions.size() << " actions\n";
+    cout << left << setw(14) << "engine" << right << setw(12) << "time (ms)" << setw(14) << "peak RSS (MB)"
+        << setw(14) << "cost" << setw(10) << "nodes" << setw(10) << "leaves" << setw(10) << "wrong" << "\n";
+    for (const auto& [name, r] : results) {
+        cout << left << setw(14) << name << right << fixed << setprecision(0) << setw(12) << r.ms
+            << setprecision(1) << setw(14) << r.peak_rss_mb
+            << setw(14) << r.cost << setw(10) << r.nodes << setw(10) << r.leaves << setw(10) << r.wrong_rules << "\n";
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -4,8 +4,8 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
-#ifndef GRAPHGEN_ROSENFELD_RULESET_H_
-#define GRAPHGEN_ROSENFELD_RULESET_H_
+#ifndef GRAPHGEN_CHAINCODE_RULESET_H_
+#define GRAPHGEN_CHAINCODE_RULESET_H_
 
 #include <string>
 
@@ -28,4 +28,4 @@ public:
 
 };
 
-#endif // GRAPHGEN_ROSENFELD_RULESET_H_
\ No newline at end of file
+#endif // GRAPHGEN_CHAINCODE_RULESET_H_
\ No newline at end of file
@@ -0,0 +1,203 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "arena_drag.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+using namespace std;
+
+static size_t Mix(uint64_t h) {
+    // Finalizer of MurmurHash3
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
+static size_t Hash(const ArenaDrag::Node& n) {
+    return Mix((uint64_t(n.data) << 32 | n.left) ^ Mix(n.right));
+}
+
+static size_t Hash(const ArenaDrag::Leaf& l) {
+    return Mix(hash<bitset<131>>()(l.action) ^ Mix(l.next));
+}
+
+static bool Equal(const ArenaDrag::Node& a, const ArenaDrag::Node& b) {
+    return a.data == b.data && a.left == b.left && a.right == b.right;
+}
+
+static bool Equal(const ArenaDrag::Leaf& a, const ArenaDrag::Leaf& b) {
+    return a.action == b.action && a.next == b.next;
+}
+
+template <typename T>
+void ArenaDrag::Rehash(vector<uint32_t>& table, const vector<T>& elems, size_t capacity) {
+    table.assign(capacity, kNone);
+    size_t mask = capacity - 1;
+    for (uint32_t e = 0; e < elems.size(); ++e) {
+        size_t i = Hash(elems[e]) & mask;
+        while (table[i] != kNone) {
+            i = (i + 1) & mask;
+        }
+        table[i] = e;
+    }
+}
+
+template <typename T>
+uint32_t ArenaDrag::Intern(vector<uint32_t>& table, vector<T>& elems, const T& e) {
+    // Keep the load factor below 1/2
+    if ((elems.size() + 1) * 2 > table.size()) {
+        Rehash(table, elems, max<size_t>(16, table.size() * 2));
+    }
+    size_t mask = table.size() - 1;
+    for (size_t i = Hash(e) & mask;; i = (i + 1) & mask) {
+        if (table[i] == kNone) {
+            elems.push_back(e);
+            return table[i] = static_cast<uint32_t>(elems.size() - 1);
+        }
+        if (Equal(elems[table[i]], e)) {
+            return table[i];
+        }
+    }
+}
+
+ArenaDrag::ArenaDrag(const BinaryDrag<conact>& bd) {
+    unordered_map<const BinaryDrag<conact>::node*, id> ids;
+    function<id(const BinaryDrag<conact>::node*)> ImportRec = [&](const BinaryDrag<conact>::node* n) -> id {
+        if (n == nullptr) {
+            return kNone;
+        }
+        auto it = ids.find(n);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        id i;
+        if (n->isleaf()) {
+            i = MakeLeaf(n->data.action, n->data.next);
+        }
+        else {
+            assert(n->left != nullptr && n->right != nullptr && "Condition nodes must have two children");
+            id l = ImportRec(n->left);
+            id r = ImportRec(n->right);
+            i = MakeNode(n->data.condition, l, r);
+        }
+        return ids[n] = i;
+    };
+
+    for (const auto& r : bd.roots_) {
+        AddRoot(ImportRec(r));
+    }
+}
+
+uint32_t ArenaDrag::InternCondition(const string& condition) {
+    auto it = conditions_pos_.emplace(condition, static_cast<uint32_t>(conditions_.size()));
+    if (it.second) {
+        conditions_.push_back(condition);
+    }
+    return it.first->second;
+}
+
+ArenaDrag::id ArenaDrag::MakeLeaf(const bitset<131>& action, size_t next) {
+    uint32_t l = Intern(leaf_table_, leaves_, Leaf{ action, next });
+    return Intern(node_table_, nodes_, Node{ l, kNone, kNone });
+}
+
+ArenaDrag::id ArenaDrag::MakeNode(uint32_t condition, id left, id right) {
+    assert(left < nodes_.size() && right < nodes_.size() && "Children must be created before their parent");
+    return Intern(node_table_, nodes_, Node{ condition, left, right });
+}
+
+void ArenaDrag::Compact() {
+    // Children have smaller ids than their parents, so a single backward pass marks all the reachable nodes
+    vector<id> new_id(nodes_.size(), kNone);
+    for (id r : roots_) {
+        if (r != kNone) {
+            new_id[r] = 0;
+        }
+    }
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        if (new_id[i] != kNone && !nodes_[i].isleaf()) {
+            new_id[nodes_[i].left] = 0;
+            new_id[nodes_[i].right] = 0;
+        }
+    }
+
+    vector<Node> nodes;
+    vector<Leaf> leaves;
+    vector<uint32_t> new_leaf(leaves_.size(), kNone);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (new_id[i] == kNone) {
+            continue;
+        }
+        Node n = nodes_[i];
+        if (n.isleaf()) {
+            if (new_leaf[n.data] == kNone) {
+                new_leaf[n.data] = static_cast<uint32_t>(leaves.size());
+                leaves.push_back(leaves_[n.data]);
+            }
+            n.data = new_leaf[n.data];
+        }
+        else {
+            n.left = new_id[n.left];
+            n.right = new_id[n.right];
+        }
+        new_id[i] = static_cast<id>(nodes.size());
+        nodes.push_back(n);
+    }
+    for (id& r : roots_) {
+        if (r != kNone) {
+            r = new_id[r];
+        }
+    }
+
+    nodes_ = move(nodes);
+    leaves_ = move(leaves);
+    Rehash(node_table_, nodes_, node_table_.size());
+    Rehash(leaf_table_, leaves_, leaf_table_.size());
+}
+
+BinaryDrag<conact> ArenaDrag::ToBinaryDrag() const {
+    vector<bool> reachable(nodes_.size(), false);
+    for (id r : roots_) {
+        if (r != kNone) {
+            reachable[r] = true;
+        }
+    }
+    for (size_t i = nodes_.size(); i-- > 0;) {
+        if (reachable[i] && !nodes_[i].isleaf()) {
+            reachable[nodes_[i].left] = true;
+            reachable[nodes_[i].right] = true;
+        }
+    }
+
+    BinaryDrag<conact> bd;
+    vector<BinaryDrag<conact>::node*> np(nodes_.size(), nullptr);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!reachable[i]) {
+            continue;
+        }
+        const Node& n = nodes_[i];
+        if (n.isleaf()) {
+            const Leaf& l = leaves_[n.data];
+            np[i] = bd.make_node();
+            np[i]->data.t = conact::type::ACTION;
+            np[i]->data.action = l.action;
+            np[i]->data.next = l.next;
+        }
+        else {
+            np[i] = bd.make_node(conact(conditions_[n.data]), np[n.left], np[n.right]);
+        }
+    }
+    for (id r : roots_) {
+        bd.AddRoot(r == kNone ? nullptr : np[r]);
+    }
+    return bd;
+}
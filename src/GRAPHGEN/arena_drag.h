@@ -0,0 +1,100 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_ARENA_DRAG_H_
+#define GRAPHGEN_ARENA_DRAG_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "condition_action.h"
+#include "drag.h"
+
+/** @brief Hash-consed DRAG of conditions and actions, stored in contiguous arrays.
+
+Nodes are addressed by 32-bit ids and stored in a single vector, conditions are interned (every node
+stores the index of its condition) and so are leaves, i.e. (action, next) pairs. Nodes are hash-consed
+when they are created: making a node with the same (condition, left, right) of an existing one returns
+the id of the existing node. In this way equal subtrees are shared by construction and two subtrees are
+equal if and only if they have the same id.
+
+Since children must exist before their parent is made, the id of a node is always greater than those
+of its children. The unique tables are open-addressing arrays of ids, so the whole structure is made of
+trivially copyable vectors (apart from the few condition names) and copying it is a memcpy.
+*/
+class ArenaDrag {
+public:
+    using id = uint32_t;
+    static constexpr id kNone = UINT32_MAX;
+
+    struct Node {
+        uint32_t data; /**< Index of the condition, or of the leaf for leaves */
+        id left;       /**< kNone for leaves */
+        id right;      /**< kNone for leaves */
+
+        bool isleaf() const { return left == kNone; }
+    };
+
+    struct Leaf {
+        std::bitset<131/*CTBE needs 131 bits*/> action;
+        size_t next;
+    };
+
+    std::vector<id> roots_;
+
+    ArenaDrag() {}
+
+    /** @brief Builds the hash-consed version of a BinaryDrag. Equal subtrees are merged */
+    explicit ArenaDrag(const BinaryDrag<conact>& bd);
+
+    /** @brief Returns the id of the interned condition, adding it if required */
+    uint32_t InternCondition(const std::string& condition);
+
+    /** @brief Returns the id of the leaf with the given action and next tree, creating it if required */
+    id MakeLeaf(const std::bitset<131>& action, size_t next = 0);
+
+    /** @brief Returns the id of the node with the given condition and children, creating it if required */
+    id MakeNode(uint32_t condition, id left, id right);
+    id MakeNode(const std::string& condition, id left, id right) {
+        return MakeNode(InternCondition(condition), left, right);
+    }
+
+    /** @brief Adds the given node to the roots */
+    void AddRoot(id n) { roots_.push_back(n); }
+
+    const Node& node(id n) const { return nodes_[n]; }
+    const Leaf& leaf(id n) const { return leaves_[nodes_[n].data]; }
+    const std::string& condition(id n) const { return conditions_[nodes_[n].data]; }
+    const std::vector<std::string>& conditions() const { return conditions_; }
+
+    /** @brief Returns the number of (distinct) nodes, leaves included */
+    size_t size() const { return nodes_.size(); }
+
+    /** @brief Removes the nodes which are not reachable from the roots, renumbering the others (in the same order) */
+    void Compact();
+
+    /** @brief Builds the BinaryDrag made of the nodes reachable from the roots */
+    BinaryDrag<conact> ToBinaryDrag() const;
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<Leaf> leaves_;
+    std::vector<std::string> conditions_;
+    std::unordered_map<std::string, uint32_t> conditions_pos_;
+
+    // Open-addressing unique tables (linear probing), storing indices in nodes_ and leaves_
+    std::vector<uint32_t> node_table_;
+    std::vector<uint32_t> leaf_table_;
+
+    template <typename T>
+    static uint32_t Intern(std::vector<uint32_t>& table, std::vector<T>& elems, const T& e);
+    template <typename T>
+    static void Rehash(std::vector<uint32_t>& table, const std::vector<T>& elems, size_t capacity);
+};
+
+#endif // !GRAPHGEN_ARENA_DRAG_H_
@@ -8,51 +8,104 @@
 #define GRAPHGEN_COLLECT_DRAG_STATISTICS_H_
 
 #include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "conact_tree.h"
 
 // This class serves to efficiently collect information about each node/subtree of a tree starting from a node
-// it both stores properties of each subtree (as string) and all the parents of each node.
+// it both stores properties of each subtree (as a hash of its structure) and all the parents of each node.
+// The statistics can be copied along with the DRAG (see the copy constructor) and updated after the merge of
+// two equivalent subtrees (see Merge), without collecting them again.
 struct CollectDragStatistics {
 
+    // Pairs of nodes already compared by STreeProp::equivalent. The same container is reused by all the
+    // comparisons, so that they don't allocate memory
+    struct PairHash {
+        size_t operator()(const std::pair<const BinaryDrag<conact>::node*, const BinaryDrag<conact>::node*>& p) const {
+            return std::hash<const void*>{}(p.first) * 31 + std::hash<const void*>{}(p.second);
+        }
+    };
+    using VisitedPairs = std::unordered_set<std::pair<const BinaryDrag<conact>::node*, const BinaryDrag<conact>::node*>, PairHash>;
+
     // Utility class to calculate and store (sub)trees properties
     struct STreeProp {
-        std::string conditions_;
-        std::vector<BinaryDrag<conact>::node*> leaves_;
+        uint64_t structure_;  // Hash of the conditions of the subtree, seen as a tree (leaves included)
+        size_t size_;         // Size of the structure: length of the conditions plus one for each leaf, seen as a tree
         BinaryDrag<conact>::node* n_;
 
-        STreeProp& operator+=(const STreeProp& rhs) {
-            conditions_ += rhs.conditions_;
-            copy(begin(rhs.leaves_), end(rhs.leaves_), back_inserter(leaves_));
-            return *this;
+        bool leaf() const { return n_->isleaf(); }
+
+        // Two subtrees are equivalent if they have the same structure and their corresponding leaves have the
+        // same next tree and at least one common action
+        bool equivalent(const STreeProp& rhs, VisitedPairs& visited) const {
+            if (structure_ != rhs.structure_ || size_ != rhs.size_)
+                return false;
+            visited.clear();
+            return EquivalentRec(n_, rhs.n_, visited);
         }
 
-        bool equivalent(const STreeProp& rhs) {
-            if (conditions_ != rhs.conditions_)
+    private:
+        static bool EquivalentRec(const BinaryDrag<conact>::node* a, const BinaryDrag<conact>::node* b, VisitedPairs& visited) {
+            if (a->isleaf() != b->isleaf())
                 return false;
-            for (size_t i = 0; i < leaves_.size(); ++i)
-                if (leaves_[i]->data.next != rhs.leaves_[i]->data.next
-                    ||
-                    (leaves_[i]->data.action & rhs.leaves_[i]->data.action) == 0)
-                    return false;
-            return true;
+            if (a->isleaf())
+                return a->data.next == b->data.next && (a->data.action & b->data.action) != 0;
+            // Pairs already visited are equivalent, otherwise the comparison would have stopped
+            if (!visited.emplace(a, b).second)
+                return true;
+            return a->data.condition == b->data.condition && EquivalentRec(a->left, b->left, visited) && EquivalentRec(a->right, b->right, visited);
         }
     };
     std::unordered_map<BinaryDrag<conact>::node*, STreeProp> np_; // Associate to each tree node its properties (STreeProp)
     std::unordered_map<BinaryDrag<conact>::node*, std::vector<BinaryDrag<conact>::node*>> parents_; // Associate to each tree node its parents (vector of nodes)
+    std::unordered_set<BinaryDrag<conact>::node*> roots_;
+
+    // Whether the DRAG has no equal subtrees. In this case Merge keeps it so, merging the subtrees which become
+    // equal, with the same result of RemoveEqualSubtrees (apart from which of the equal subtrees is kept)
+    bool minimal_ = true;
 
     CollectDragStatistics() {}
     CollectDragStatistics(BinaryDrag<conact>& bd) {
         for (const auto& t : bd.roots_) {
+            roots_.insert(t);
             CollectStatsRec(t);
-            //CollectStatsRec(t->left);
-            //CollectStatsRec(t->right);
+        }
+    }
+
+    // Statistics of a copy of the DRAG, given the copy of each of its nodes
+    CollectDragStatistics(const CollectDragStatistics& cds, const std::unordered_map<BinaryDrag<conact>::node*, BinaryDrag<conact>::node*>& copies)
+        : minimal_{ cds.minimal_ }
+    {
+        np_.reserve(cds.np_.size());
+        for (const auto& [n, sp] : cds.np_) {
+            STreeProp csp = sp;
+            csp.n_ = copies.at(n);
+            np_.emplace(csp.n_, csp);
+        }
+        parents_.reserve(cds.parents_.size());
+        for (const auto& [n, p] : cds.parents_) {
+            auto& cp = parents_[copies.at(n)];
+            cp.reserve(p.size());
+            for (auto x : p) {
+                cp.push_back(copies.at(x));
+            }
+        }
+        for (auto r : cds.roots_) {
+            roots_.insert(copies.at(r));
+        }
+        unique_.reserve(cds.unique_.size());
+        for (const auto& [k, n] : cds.unique_) {
+            auto c = copies.at(n);
+            unique_.emplace(Key(c), c);
         }
     }
 
     // Collect information about each node/subtree of a tree starting from a node
-    STreeProp CollectStatsRec(BinaryDrag<conact>::node * n) {
+    const STreeProp& CollectStatsRec(BinaryDrag<conact>::node * n) {
         auto it = np_.find(n);
         if (it != end(np_))
             return it->second;
@@ -60,19 +113,184 @@ struct CollectDragStatistics {
         STreeProp sp;
         sp.n_ = n;
         if (n->isleaf()) {
-            sp.conditions_ = ".";
-            sp.leaves_.push_back(n);
+            sp.structure_ = 0x9e3779b97f4a7c15ull;
+            sp.size_ = 1;
         }
         else {
             parents_[n->left].push_back(n);
             parents_[n->right].push_back(n);
-            sp.conditions_ = n->data.condition;
-            sp += CollectStatsRec(n->left);
-            sp += CollectStatsRec(n->right);
+            const STreeProp& l = CollectStatsRec(n->left);
+            const STreeProp& r = CollectStatsRec(n->right);
+            sp.structure_ = Combine(Combine(std::hash<std::string>{}(n->data.condition), l.structure_), r.structure_);
+            sp.size_ = n->data.condition.size() + l.size_ + r.size_;
+        }
+        if (!unique_.emplace(Key(n), n).second)
+            minimal_ = false;
+
+        return np_[n] = sp;
+    }
+
+    // Merges the equivalent subtrees rooted in a and b of bd: the parents of b (and of its nodes) are linked to a
+    // (and to the corresponding nodes), and the actions of the leaves of a are restricted to the common ones.
+    // Then, if the DRAG had no equal subtrees, the subtrees which became equal are merged as well.
+    //
+    // The properties of the ancestors don't change, since merged subtrees have the same structure: only the
+    // merged nodes and their ancestors whose children changed are updated, and the nodes which are no longer
+    // reachable are removed, so that the update costs time proportional to the merged subtrees rather than to
+    // the whole DRAG.
+    void Merge(BinaryDrag<conact>& bd, BinaryDrag<conact>::node* a, BinaryDrag<conact>::node* b) {
+        std::unordered_set<BinaryDrag<conact>::node*> visited;
+        std::vector<std::pair<BinaryDrag<conact>::node*, BinaryDrag<conact>::node*>> links; // (node, new parent)
+        std::vector<BinaryDrag<conact>::node*> unlinked;
+        std::vector<BinaryDrag<conact>::node*> changed;
+        MergeRec(a, b, visited, links, unlinked, changed);
+
+        // New parents are recorded after the merge, so that each node is relinked according to the parents it had before
+        for (const auto& [n, p] : links) {
+            parents_[n].push_back(p);
+        }
+        RemoveUnreachable(unlinked);
+
+        if (minimal_) {
+            MergeEqual(bd, changed);
+        }
+    }
+
+private:
+    // Content of a node: condition and children for nodes, actions and next tree for leaves. In a DRAG without
+    // equal subtrees, two subtrees are equal if and only if their roots have the same content
+    struct Key {
+        std::string condition;
+        const BinaryDrag<conact>::node* left;
+        const BinaryDrag<conact>::node* right;
+        std::bitset<131> action;
+        size_t next;
+
+        Key(const BinaryDrag<conact>::node* n) : left{ n->left }, right{ n->right } {
+            if (n->isleaf()) {
+                action = n->data.action;
+                next = n->data.next;
+            }
+            else {
+                condition = n->data.condition;
+                next = 0;
+            }
         }
 
-        np_[n] = sp;
-        return sp;
+        bool operator==(const Key& rhs) const {
+            return left == rhs.left && right == rhs.right && next == rhs.next && action == rhs.action && condition == rhs.condition;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return static_cast<size_t>(Combine(Combine(Combine(std::hash<std::string>{}(k.condition), std::hash<const void*>{}(k.left)),
+                                                       std::hash<const void*>{}(k.right)), std::hash<std::bitset<131>>{}(k.action) + k.next));
+        }
+    };
+    std::unordered_map<Key, BinaryDrag<conact>::node*, KeyHash> unique_; // Node with each content
+
+    static uint64_t Combine(uint64_t h, uint64_t v) {
+        h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        // Finalizer of MurmurHash3
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Must be called before changing the content of n
+    void Unregister(BinaryDrag<conact>::node* n) {
+        auto it = unique_.find(Key(n));
+        if (it != end(unique_) && it->second == n)
+            unique_.erase(it);
+    }
+
+    void MergeRec(BinaryDrag<conact>::node* a, BinaryDrag<conact>::node* b, std::unordered_set<BinaryDrag<conact>::node*>& visited,
+                  std::vector<std::pair<BinaryDrag<conact>::node*, BinaryDrag<conact>::node*>>& links, std::vector<BinaryDrag<conact>::node*>& unlinked,
+                  std::vector<BinaryDrag<conact>::node*>& changed) {
+        if (!visited.insert(a).second)
+            return;
+
+        if (a != b) {
+            auto& pb = parents_[b];
+            for (auto& x : pb) {
+                Unregister(x);
+                if (x->left == b)
+                    x->left = a;
+                else
+                    x->right = a;
+                links.emplace_back(a, x);
+                changed.push_back(x);
+            }
+            pb.clear();
+            unlinked.push_back(b);
+        }
+
+        if (a->isleaf()) {
+            Unregister(a);
+            a->data.action &= b->data.action;
+            changed.push_back(a);
+        }
+        else {
+            MergeRec(a->left, b->left, visited, links, unlinked, changed);
+            MergeRec(a->right, b->right, visited, links, unlinked, changed);
+        }
+    }
+
+    // Removes the nodes without parents (apart from roots), and unlinks them from their children
+    void RemoveUnreachable(std::vector<BinaryDrag<conact>::node*>& unlinked) {
+        while (!unlinked.empty()) {
+            auto n = unlinked.back();
+            unlinked.pop_back();
+            auto it = parents_.find(n);
+            if (roots_.count(n) || np_.count(n) == 0 || (it != end(parents_) && !it->second.empty()))
+                continue;
+            Unregister(n);
+            np_.erase(n);
+            parents_.erase(n);
+            if (!n->isleaf()) {
+                for (auto c : { n->left, n->right }) {
+                    auto& p = parents_[c];
+                    p.erase(std::remove(begin(p), end(p), n), end(p));
+                    unlinked.push_back(c);
+                }
+            }
+        }
+    }
+
+    // Registers the nodes whose content changed, replacing each one with the node with the same content, if any.
+    // Replacements change the content of the parents of the replaced nodes, which are processed in turn.
+    void MergeEqual(BinaryDrag<conact>& bd, std::vector<BinaryDrag<conact>::node*>& changed) {
+        std::vector<BinaryDrag<conact>::node*> unlinked;
+        while (!changed.empty()) {
+            auto n = changed.back();
+            changed.pop_back();
+            if (np_.count(n) == 0)
+                continue;
+            auto [it, inserted] = unique_.emplace(Key(n), n);
+            auto m = it->second;
+            if (inserted || m == n)
+                continue;
+
+            // The equal subtree m replaces n
+            auto& pn = parents_[n];
+            for (auto x : pn) {
+                Unregister(x);
+                if (x->left == n)
+                    x->left = m;
+                else
+                    x->right = m;
+                parents_[m].push_back(x);
+                changed.push_back(x);
+            }
+            pn.clear();
+            if (roots_.erase(n)) {
+                std::replace(begin(bd.roots_), end(bd.roots_), n, m);
+                roots_.insert(m);
+            }
+            unlinked.push_back(n);
+            RemoveUnreachable(unlinked);
+        }
     }
 };
 
@@ -0,0 +1,231 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "conact_drag_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "conact_tree.h"
+
+using namespace std;
+
+static_assert(sizeof(DragFileHeader) % 8 == 0, "DragFileHeader size must be a multiple of 8");
+static_assert(sizeof(DragFileNode) % 8 == 0, "DragFileNode size must be a multiple of 8");
+
+static size_t Align8(size_t offset) {
+    return (offset + 7) / 8 * 8;
+}
+
+static void ThrowError(const string& what, const string& filename) {
+    throw runtime_error("MappedConactDrag: " + what + " in '" + filename + "'.");
+}
+
+MappedConactDrag::MappedConactDrag(const string& filename) : file_{ filename } {
+    if (file_.size() < sizeof(DragFileHeader)) {
+        ThrowError("missing header", filename);
+    }
+    header_ = file_.as<DragFileHeader>();
+    if (memcmp(header_->magic, DragFileHeader::kMagic, sizeof(DragFileHeader::kMagic)) != 0) {
+        ThrowError("wrong magic number", filename);
+    }
+    if (header_->byte_order != DragFileHeader::kByteOrder) {
+        ThrowError("unsupported byte order", filename);
+    }
+    if (header_->version != DragFileHeader::kVersion) {
+        ThrowError("unsupported version", filename);
+    }
+    if (header_->action_words != DragFileNode::kActionWords) {
+        ThrowError("unsupported number of actions", filename);
+    }
+    if (header_->file_size != file_.size() || header_->num_nodes > DragFileNode::kNone ||
+        header_->nodes_offset + header_->num_nodes * sizeof(DragFileNode) > header_->roots_offset ||
+        header_->roots_offset + header_->num_roots * sizeof(uint32_t) > header_->conditions_offset ||
+        header_->conditions_offset + (header_->num_conditions + 1ull) * sizeof(uint64_t) > header_->file_size ||
+        header_->nodes_offset % 8 != 0 || header_->conditions_offset % 8 != 0) {
+        ThrowError("corrupted sections", filename);
+    }
+    nodes_ = file_.as<DragFileNode>(static_cast<size_t>(header_->nodes_offset));
+    roots_ = file_.as<uint32_t>(static_cast<size_t>(header_->roots_offset));
+    condition_offsets_ = file_.as<uint64_t>(static_cast<size_t>(header_->conditions_offset));
+    condition_names_ = reinterpret_cast<const char*>(condition_offsets_ + header_->num_conditions + 1);
+}
+
+BinaryDrag<conact> MappedConactDrag::ToBinaryDrag() const {
+    const string& filename = file_.path().string();
+    size_t names_size = file_.size() - (condition_names_ - file_.data());
+
+    vector<string> conditions(num_conditions());
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        if (condition_offsets_[i] > condition_offsets_[i + 1] || condition_offsets_[i + 1] > names_size) {
+            ThrowError("corrupted conditions table", filename);
+        }
+        conditions[i] = string(condition(i));
+    }
+
+    BinaryDrag<conact> t;
+    t.nodes_.reserve(num_nodes());
+    vector<BinaryDrag<conact>::node*> np(num_nodes());
+
+    // Children precede their parents, so indices can be checked against the current one
+    auto child = [&](uint32_t c, size_t i) -> BinaryDrag<conact>::node* {
+        if (c == DragFileNode::kNone) {
+            return nullptr;
+        }
+        if (c >= i) {
+            ThrowError("corrupted node table", filename);
+        }
+        return np[c];
+    };
+
+    for (size_t i = 0; i < np.size(); ++i) {
+        const DragFileNode& fn = nodes_[i];
+        auto n = np[i] = t.make_node();
+        if (fn.isleaf()) {
+            n->data.t = conact::type::ACTION;
+            n->data.next = static_cast<size_t>(fn.next);
+            for (size_t b = 0; b < n->data.action.size(); ++b) {
+                n->data.action[b] = (fn.action[b / 64] >> (b % 64)) & 1;
+            }
+        }
+        else {
+            if (fn.condition >= conditions.size()) {
+                ThrowError("corrupted node table", filename);
+            }
+            n->data.t = conact::type::CONDITION;
+            n->data.condition = conditions[fn.condition];
+        }
+        n->left = child(fn.left, i);
+        n->right = child(fn.right, i);
+    }
+
+    for (size_t i = 0; i < num_roots(); ++i) {
+        t.AddRoot(child(roots_[i], np.size()));
+    }
+    return t;
+}
+
+// Appends to the node table the subgraph rooted in n, children first. Every node is added once.
+static uint32_t WriteNodesRec(const BinaryDrag<conact>::node* n,
+                              unordered_map<const BinaryDrag<conact>::node*, uint32_t>& ids,
+                              unordered_map<string, uint32_t>& condition_ids,
+                              vector<string>& conditions,
+                              vector<DragFileNode>& nodes)
+{
+    if (n == nullptr) {
+        return DragFileNode::kNone;
+    }
+    auto it = ids.find(n);
+    if (it != ids.end()) {
+        return it->second;
+    }
+
+    DragFileNode fn{};
+    fn.left = WriteNodesRec(n->left, ids, condition_ids, conditions, nodes);
+    fn.right = WriteNodesRec(n->right, ids, condition_ids, conditions, nodes);
+    if (n->data.t == conact::type::ACTION) {
+        fn.condition = DragFileNode::kNone;
+        fn.next = n->data.next;
+        for (size_t b = 0; b < n->data.action.size(); ++b) {
+            if (n->data.action[b]) {
+                fn.action[b / 64] |= uint64_t(1) << (b % 64);
+            }
+        }
+    }
+    else {
+        auto c = condition_ids.emplace(n->data.condition, static_cast<uint32_t>(conditions.size()));
+        if (c.second) {
+            conditions.push_back(n->data.condition);
+        }
+        fn.condition = c.first->second;
+    }
+
+    nodes.push_back(fn);
+    return ids[n] = static_cast<uint32_t>(nodes.size() - 1);
+}
+
+bool WriteConactDragBinary(const BinaryDrag<conact>& t, const string& filename)
+{
+    unordered_map<const BinaryDrag<conact>::node*, uint32_t> ids;
+    unordered_map<string, uint32_t> condition_ids;
+    vector<string> conditions;
+    vector<DragFileNode> nodes;
+    vector<uint32_t> roots;
+    for (const auto& r : t.roots_) {
+        roots.push_back(WriteNodesRec(r, ids, condition_ids, conditions, nodes));
+    }
+
+    vector<uint64_t> condition_offsets(1, 0);
+    for (const auto& c : conditions) {
+        condition_offsets.push_back(condition_offsets.back() + c.size());
+    }
+
+    DragFileHeader h{};
+    memcpy(h.magic, DragFileHeader::kMagic, sizeof(h.magic));
+    h.byte_order = DragFileHeader::kByteOrder;
+    h.version = DragFileHeader::kVersion;
+    h.action_words = DragFileNode::kActionWords;
+    h.num_conditions = static_cast<uint32_t>(conditions.size());
+    h.num_nodes = nodes.size();
+    h.num_roots = roots.size();
+    h.nodes_offset = sizeof(DragFileHeader);
+    h.roots_offset = h.nodes_offset + nodes.size() * sizeof(DragFileNode);
+    h.conditions_offset = Align8(static_cast<size_t>(h.roots_offset + roots.size() * sizeof(uint32_t)));
+    h.file_size = h.conditions_offset + condition_offsets.size() * sizeof(uint64_t) + condition_offsets.back();
+
+    ofstream os(filename, ios::binary);
+    if (!os) {
+        return false;
+    }
+    os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    os.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(DragFileNode));
+    os.write(reinterpret_cast<const char*>(roots.data()), roots.size() * sizeof(uint32_t));
+    os.write("\0\0\0\0\0\0\0", static_cast<streamsize>(h.conditions_offset - (h.roots_offset + roots.size() * sizeof(uint32_t))));
+    os.write(reinterpret_cast<const char*>(condition_offsets.data()), condition_offsets.size() * sizeof(uint64_t));
+    for (const auto& c : conditions) {
+        os.write(c.data(), c.size());
+    }
+    return static_cast<bool>(os);
+}
+
+bool LoadConactDragBinary(BinaryDrag<conact>& t, const string& filename)
+{
+    try {
+        t = MappedConactDrag(filename).ToBinaryDrag();
+    }
+    catch (const runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool ConvertConactDragTextToBinary(const string& text_filename, const string& binary_filename)
+{
+    ifstream is(text_filename);
+    if (!is) {
+        return false;
+    }
+    BinaryDrag<conact> t;
+    Load load(is, t);
+    return WriteConactDragBinary(t, binary_filename);
+}
+
+bool ConvertConactDragBinaryToText(const string& binary_filename, const string& text_filename)
+{
+    BinaryDrag<conact> t;
+    if (!LoadConactDragBinary(t, binary_filename)) {
+        return false;
+    }
+    ofstream os(text_filename);
+    if (!os) {
+        return false;
+    }
+    Save save(os, t);
+    return static_cast<bool>(os);
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_CONACT_DRAG_FILE_H_
+#define GRAPHGEN_CONACT_DRAG_FILE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "condition_action.h"
+#include "drag.h"
+#include "mapped_file.h"
+
+/** @brief Binary file format of a BinaryDrag<conact>.
+
+The file is made of the following sections, all of them aligned to 8 bytes and stored with the
+byte order of the machine which wrote the file (checked when the file is opened):
+- the header (DragFileHeader);
+- the node table, num_nodes DragFileNode. Children always precede their parents, so the table
+  can be loaded with a single pass, and every node appears exactly once, so shared nodes (and
+  thus the DRAG structure) are preserved;
+- the roots, num_roots uint32_t indices in the node table;
+- the conditions table, num_conditions + 1 uint64_t offsets followed by the names of the
+  conditions. The name of condition i is in [offsets[i], offsets[i + 1]) of the names area.
+
+Condition nodes store the index of their condition in the conditions table, so names are never
+parsed while loading the file. Since records have a fixed size, the file can be directly used
+through a memory mapping (see MappedConactDrag).
+*/
+struct DragFileHeader {
+    static constexpr char kMagic[8] = { 'G', 'G', 'D', 'R', 'A', 'G', '\0', '\0' };
+    static constexpr uint32_t kByteOrder = 0x01020304;
+    static constexpr uint32_t kVersion = 1;
+
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t action_words;
+    uint32_t num_conditions;
+    uint64_t num_nodes;
+    uint64_t num_roots;
+    uint64_t nodes_offset;
+    uint64_t roots_offset;
+    uint64_t conditions_offset;
+    uint64_t file_size;
+};
+
+/** @brief Node of the binary DRAG file format, see DragFileHeader */
+struct DragFileNode {
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr size_t kActionWords = (decltype(conact::action)().size() + 63) / 64;
+
+    uint32_t condition; /**< Index in the conditions table, kNone for leaves */
+    uint32_t left;      /**< Index in the node table of the left child, kNone if missing */
+    uint32_t right;     /**< Index in the node table of the right child, kNone if missing */
+    uint32_t reserved;
+    uint64_t next;      /**< Next tree (leaves only) */
+    uint64_t action[kActionWords]; /**< Bitmapped actions (leaves only) */
+
+    bool isleaf() const { return condition == kNone; }
+};
+
+/** @brief Read-only view of a BinaryDrag<conact> stored in the binary file format.
+
+The file is memory-mapped, so opening it requires constant time, independently of the size of the
+DRAG: nodes are read directly from the mapping when accessed. Use ToBinaryDrag() to obtain a
+modifiable BinaryDrag. Errors (missing or corrupted files) are reported throwing a std::runtime_error.
+*/
+class MappedConactDrag {
+    MappedFile file_;
+    const DragFileHeader* header_;
+    const DragFileNode* nodes_;
+    const uint32_t* roots_;
+    const uint64_t* condition_offsets_;
+    const char* condition_names_;
+
+public:
+    /** @brief Maps the specified file and checks its header */
+    MappedConactDrag(const std::string& filename);
+
+    size_t num_nodes() const { return static_cast<size_t>(header_->num_nodes); }
+    size_t num_roots() const { return static_cast<size_t>(header_->num_roots); }
+    size_t num_conditions() const { return header_->num_conditions; }
+
+    const DragFileNode& node(size_t i) const { return nodes_[i]; }
+    /** @brief Returns the index of the i-th root in the node table */
+    uint32_t root(size_t i) const { return roots_[i]; }
+    std::string_view condition(size_t i) const {
+        return std::string_view(condition_names_ + condition_offsets_[i], static_cast<size_t>(condition_offsets_[i + 1] - condition_offsets_[i]));
+    }
+
+    /** @brief Builds the BinaryDrag stored in the file, preserving shared nodes */
+    BinaryDrag<conact> ToBinaryDrag() const;
+};
+
+/** @brief Saves a BinaryDrag in the binary file format (see DragFileHeader) */
+bool WriteConactDragBinary(const BinaryDrag<conact>& t, const std::string& filename);
+
+/** @brief Loads a BinaryDrag from a file in the binary format (see DragFileHeader)
+
+@param [out] t Loaded DRAG, with the same shared nodes of the saved one
+@param [in] filename Name of the file (path) from which load the DRAG
+
+@return whether the DRAG has been correctly loaded or not
+*/
+bool LoadConactDragBinary(BinaryDrag<conact>& t, const std::string& filename);
+
+/** @brief Converts a DRAG from the text format (the one of the Save and Load structs in conact_tree.h) to the binary one */
+bool ConvertConactDragTextToBinary(const std::string& text_filename, const std::string& binary_filename);
+
+/** @brief Converts a DRAG from the binary format to the text one (the one of the Save and Load structs in conact_tree.h) */
+bool ConvertConactDragBinaryToText(const std::string& binary_filename, const std::string& text_filename);
+
+#endif // !GRAPHGEN_CONACT_DRAG_FILE_H_
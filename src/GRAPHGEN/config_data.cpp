@@ -95,4 +95,77 @@ ConfigData::ConfigData(string& algorithm_name, const string& mask_name, bool use
     if (config["force_odt_generation"]) {
         force_odt_generation_ = config["force_odt_generation"].as<bool>();
     }
+
+    odt_cache_path_ = global_output_path_ / "odt_cache";
+    if (config["odt_cache"]["enabled"]) {
+        odt_cache_ = config["odt_cache"]["enabled"].as<bool>();
+    }
+    if (config["odt_cache"]["path"]) {
+        odt_cache_path_ = path(config["odt_cache"]["path"].as<string>());
+    }
+
+    if (config["hypercube"]["threads"]) {
+        hypercube_threads_ = config["hypercube"]["threads"].as<size_t>();
+    }
+    if (config["hypercube"]["engine"]) {
+        odt_engine_ = config["hypercube"]["engine"].as<string>();
+    }
+    hypercube_path_ = algorithm_output_path_ / "hypercube";
+    if (config["hypercube"]["path"]) {
+        hypercube_path_ = path(config["hypercube"]["path"].as<string>());
+    }
+
+    if (config["frequencies"]["readers"]) {
+        frequencies_readers_ = config["frequencies"]["readers"].as<size_t>();
+    }
+    if (config["frequencies"]["counters"]) {
+        frequencies_counters_ = config["frequencies"]["counters"].as<size_t>();
+    }
+    if (config["frequencies"]["incremental"]) {
+        frequencies_incremental_ = config["frequencies"]["incremental"].as<bool>();
+    }
+
+    if (config["drag_compressor"]["threads"]) {
+        drag_compressor_threads_ = config["drag_compressor"]["threads"].as<size_t>();
+    }
+    if (config["drag_compressor"]["forest_threads"]) {
+        drag_compressor_forest_threads_ = config["drag_compressor"]["forest_threads"].as<size_t>();
+    }
+    if (config["drag_compressor"]["explored_table_mb"]) {
+        drag_compressor_table_mb_ = config["drag_compressor"]["explored_table_mb"].as<size_t>();
+    }
+    if (config["drag_compressor"]["pruning"]) {
+        drag_compressor_pruning_ = config["drag_compressor"]["pruning"].as<bool>();
+    }
+    if (config["drag_compressor"]["time_budget"]) {
+        drag_compressor_time_budget_ = config["drag_compressor"]["time_budget"].as<double>();
+    }
+    if (config["drag_compressor"]["checkpoints"]) {
+        drag_compressor_checkpoints_ = config["drag_compressor"]["checkpoints"].as<bool>();
+    }
+    if (config["drag_compressor"]["checkpoint_interval"]) {
+        drag_compressor_checkpoint_interval_ = config["drag_compressor"]["checkpoint_interval"].as<double>();
+    }
+    drag_compressor_checkpoint_path_ = algorithm_output_path_ / "drag_compressor_checkpoints";
+    if (config["drag_compressor"]["checkpoint_path"]) {
+        drag_compressor_checkpoint_path_ = path(config["drag_compressor"]["checkpoint_path"].as<string>());
+    }
+    if (config["drag_compressor"]["beam_width"]) {
+        drag_compressor_beam_width_ = config["drag_compressor"]["beam_width"].as<size_t>();
+    }
+    if (config["drag_compressor"]["annealing_iterations"]) {
+        drag_compressor_annealing_iterations_ = config["drag_compressor"]["annealing_iterations"].as<size_t>();
+    }
+    if (config["drag_compressor"]["temperature"]) {
+        drag_compressor_temperature_ = config["drag_compressor"]["temperature"].as<double>();
+    }
+    if (config["drag_compressor"]["cooling"]) {
+        drag_compressor_cooling_ = config["drag_compressor"]["cooling"].as<double>();
+    }
+    if (config["drag_compressor"]["seed"]) {
+        drag_compressor_seed_ = config["drag_compressor"]["seed"].as<uint64_t>();
+    }
+    if (config["drag_compressor"]["best_known"]) {
+        drag_compressor_best_known_ = config["drag_compressor"]["best_known"].as<bool>();
+    }
 }
\ No newline at end of file
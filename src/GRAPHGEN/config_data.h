@@ -7,6 +7,8 @@
 #ifndef GRAPGHSGEN_CONFIG_DATA_H_
 #define GRAPGHSGEN_CONFIG_DATA_H_
 
+#include <cstdint>
+#include <cstdio>
 #include <filesystem>
 #include <iostream>
 #include <numeric>
@@ -71,6 +73,12 @@ struct ConfigData {
     std::string frequencies_local_path_ = "frequencies";
     std::filesystem::path frequencies_path_;
     std::string frequencies_suffix_ = ".bin";
+    std::string frequencies_files_suffix_ = ".files";   // Images which contributed to the frequencies
+    // Number of threads which load the images of datasets, and which count the frequencies on them (0 means one for each hardware core)
+    size_t frequencies_readers_ = 1;
+    size_t frequencies_counters_ = 1;
+    // Whether only the images added to datasets since their frequencies were stored are counted
+    bool frequencies_incremental_ = false;
 
     // CTBE Ruleset path
     std::filesystem::path ctbe_rstable_path_;
@@ -82,6 +90,48 @@ struct ConfigData {
 
 	bool force_odt_generation_ = false;
 
+    // Content-addressed cache of the optimal decision trees, shared by all the algorithms
+    bool odt_cache_ = true;
+    std::filesystem::path odt_cache_path_;
+    std::string odt_cache_suffix_ = "_odt.bin";
+
+    // Name of the engine used to generate the optimal decision tree (see OdtEngineRegistry)
+    std::string odt_engine_ = "index";
+    // Number of threads used to optimize the hypercube (0 means one for each hardware core)
+    size_t hypercube_threads_ = 1;
+    // Directory where the files of the out-of-core hypercube are stored
+    std::filesystem::path hypercube_path_;
+
+    // Number of threads used by the DragCompressor to search the best sequence of merges (0 means one for each hardware core)
+    size_t drag_compressor_threads_ = 1;
+    // Number of forests generated and compressed concurrently (0 means one for each hardware core)
+    size_t drag_compressor_forest_threads_ = 1;
+    // Memory (MiB) of the table of the DRAGs already explored by the DragCompressor (0 disables the table). Searches
+    // with early stopping don't use it
+    size_t drag_compressor_table_mb_ = 256;
+    // Whether the DragCompressor cuts the branches of the search which can't lead to a better DRAG (never done by
+    // searches with early stopping)
+    bool drag_compressor_pruning_ = true;
+    // Maximum time (seconds) spent by the DragCompressor on each forest (0 means no limit)
+    double drag_compressor_time_budget_ = 0;
+    // Whether the DragCompressor periodically saves the state of the search, to resume it in later runs
+    bool drag_compressor_checkpoints_ = false;
+    // Seconds between two checkpoints of the DragCompressor
+    double drag_compressor_checkpoint_interval_ = 60;
+    // Directory where the checkpoints of the DragCompressor are stored
+    std::filesystem::path drag_compressor_checkpoint_path_;
+    // Number of DRAGs kept at each level by the beam search of the DragCompressor (BEAM_SEARCH flag)
+    size_t drag_compressor_beam_width_ = 8;
+    // Number of neighbours evaluated by the simulated annealing of the DragCompressor (SIMULATED_ANNEALING flag)
+    size_t drag_compressor_annealing_iterations_ = 1000;
+    // Initial temperature (in nodes) of the simulated annealing and its multiplier after each iteration
+    double drag_compressor_temperature_ = 2;
+    double drag_compressor_cooling_ = 0.995;
+    // Seed of the random generator of the simulated annealing
+    uint64_t drag_compressor_seed_ = 0;
+    // Whether the DragCompressor records the nodes of every compressed forest among the best known results
+    bool drag_compressor_best_known_ = false;
+
     ConfigData() {}
 
     ConfigData(std::string& algorithm_name, const std::string& mask_name, bool use_frequencies = false);
@@ -111,6 +161,13 @@ struct ConfigData {
         return algorithm_output_path_ / std::filesystem::path(algorithm_name_ + "_" + custom_suffix + odt_suffix_);
     }
 
+    // ODT cache entry of the rule set with the given hash (see rule_set::Hash())
+    std::filesystem::path GetOdtCachePath(uint64_t rule_set_hash) const {
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(rule_set_hash));
+        return odt_cache_path_ / std::filesystem::path(name + odt_cache_suffix_);
+    }
+
     std::string GetDatasetsString(const std::string& separator = ", ") {
         std::string dataset_names;
         bool first = true;
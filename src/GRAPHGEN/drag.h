@@ -131,6 +131,13 @@ public:
         }
     }
 
+    /** @brief Special copy constructor that maps every (reachable) node of bd to its copy */
+    BinaryDrag(const BinaryDrag& bd, std::unordered_map<node*, node*>& copies) {
+        for (const auto& x : bd.roots_) {
+            roots_.push_back(MakeCopyRecursive(x, copies));
+        }
+    }
+
     BinaryDrag(BinaryDrag&& t) {
         swap(*this, t);
     }
@@ -28,87 +28,148 @@
 
 #include "drag2optimal.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "arena_drag.h"
 #include "drag_statistics.h"
+#include "remove_equal_subtrees.h"
 
-void FindAndLinkIdentiesDagRec(BinaryDrag<conact>::node* n1, BinaryDrag<conact>::node* n2, std::map<BinaryDrag<conact>::node*, bool> &visited_fl) {
-    if (n2->isleaf() || n1 == n2 || visited_fl[n2])
-        return;
-    visited_fl[n2] = true;
+// Converts dag to dag using identies between subtrees. Every subtree reachable from the root is
+// linked to the first equal one found in a depth-first visit, which is what RemoveEqualSubtrees does
+// with a single pass over the nodes.
+void Dag2DagUsingIdenties(BinaryDrag<conact>& t) {
+	RemoveEqualSubtrees{ t.roots_.front() };
+}
 
-    if (n1 != n2->left && EqualTrees(n1, n2->left)) {
-        n2->left = n1;
-    }
+// Links every subtree reachable from the root to the first equivalent one found in a depth-first visit.
+// Equivalence is not transitive (leaves are equivalent when their actions intersect), so the visit order
+// matters: when node n is visited every edge pointing to a subtree equivalent to n is redirected to n.
+// Candidate edges are grouped by the shape of their target, i.e. the subtree without leaf actions, which
+// is the same for equivalent subtrees and never changes, since subtrees are only replaced by equivalent
+// ones. Leaves are also grouped by action, because their data never changes. In this way each node is
+// only compared with the few subtrees with its shape, instead of scanning the whole DAG.
+class Dag2DagUsingEquivalencesImpl {
+	using node = BinaryDrag<conact>::node;
 
-    if (n1 != n2->right && EqualTrees(n1, n2->right)) {
-        n2->right = n1;
-    }
+	struct Edge {
+		node* parent;
+		bool right;
 
-    FindAndLinkIdentiesDagRec(n1, n2->left, visited_fl);
-    FindAndLinkIdentiesDagRec(n1, n2->right, visited_fl);
-}
+		node* target() const { return right ? parent->right : parent->left; }
+		void link(node* n) { (right ? parent->right : parent->left) = n; }
+	};
 
-// Recursive auxiliary function for the conversion of a DAG into DAG with no equivalent subgraphs
-void Dag2DagUsingIdentiesRec(BinaryDrag<conact>::node *n, BinaryDrag<conact>& t, std::map<BinaryDrag<conact>::node*, bool> &visited_n) {
-    std::map<BinaryDrag<conact>::node*, bool> visited_fl;
-    FindAndLinkIdentiesDagRec(n, t.GetRoot(), visited_fl);
-    visited_n[n] = true;
-
-    if (!n->isleaf()) {
-        if (!visited_n[n->left])
-            Dag2DagUsingIdentiesRec(n->left, t, visited_n);
-        if (!visited_n[n->right])
-            Dag2DagUsingIdentiesRec(n->right, t, visited_n);
-    }
-}
+	ArenaDrag shapes_;
+	std::unordered_map<const node*, ArenaDrag::id> shape_;
+	std::unordered_map<uint64_t, std::vector<Edge>> edges_; // (shape, action of the leaf) -> edges
+	std::unordered_map<const node*, size_t> refs_; // Number of edges from nodes reachable from the root
+	std::unordered_set<const node*> visited_;
+	bool considering_leaves_;
 
-// Converts dag to dag using identies between subtrees
-void Dag2DagUsingIdenties(BinaryDrag<conact>& t) {
-	std::map<BinaryDrag<conact>::node*, bool> visited_n;
-	Dag2DagUsingIdentiesRec(t.GetRoot(), t, visited_n);
-}
+	static uint64_t Key(ArenaDrag::id shape, size_t action = 0) {
+		return uint64_t(shape) << 8 | action;
+	}
 
-void FindAndLinkEquivalencesDagRec(BinaryDrag<conact>::node* n1, BinaryDrag<conact>::node* n2, std::map<BinaryDrag<conact>::node*, bool> &visited_fl) {
-	if (n2->isleaf() || n1 == n2 || visited_fl[n2])
-		return;
-	visited_fl[n2] = true;
+	ArenaDrag::id ShapeRec(node* n) {
+		auto it = shape_.find(n);
+		if (it != shape_.end()) {
+			return it->second;
+		}
+		ArenaDrag::id shape;
+		if (n->isleaf()) {
+			shape = shapes_.MakeLeaf(0, n->data.next);
+		}
+		else {
+			auto l = ShapeRec(n->left);
+			auto r = ShapeRec(n->right);
+			++refs_[n->left];
+			++refs_[n->right];
+			shape = shapes_.MakeNode(n->data.condition, l, r);
+			AddEdge({ n, false });
+			AddEdge({ n, true });
+		}
+		return shape_[n] = shape;
+	}
 
-	if (n1 != n2->left && equivalent_trees(n1, n2->left)) {
-		n2->left = n1;
+	void AddEdge(const Edge& e) {
+		const node* n = e.target();
+		if (n->isleaf()) {
+			for (size_t a = 0; a < n->data.action.size(); ++a) {
+				if (n->data.action[a]) {
+					edges_[Key(shape_[n], a)].push_back(e);
+				}
+			}
+		}
+		else {
+			edges_[Key(shape_[n])].push_back(e);
+		}
 	}
 
-	if (n1 != n2->right && equivalent_trees(n1, n2->right)) {
-		n2->right = n1;
+	// Nodes which are no longer reachable from the root may still be reachable from other roots, so
+	// their edges must not be modified
+	void Unref(const node* n) {
+		if (--refs_[n] == 0 && !n->isleaf()) {
+			Unref(n->left);
+			Unref(n->right);
+		}
 	}
 
-	FindAndLinkEquivalencesDagRec(n1, n2->left, visited_fl);
-	FindAndLinkEquivalencesDagRec(n1, n2->right, visited_fl);
-}
+	void Link(node* n, uint64_t key) {
+		auto it = edges_.find(key);
+		if (it == edges_.end()) {
+			return;
+		}
+		for (auto& e : it->second) {
+			node* c = e.target();
+			if (c != n && refs_[e.parent] > 0 && equivalent_trees(n, c)) {
+				e.link(n);
+				++refs_[n];
+				Unref(c);
+			}
+		}
+	}
 
-// Recursive auxiliary function for the conversion of a DAG into DAG with no equivalent subgraphs
-void Dag2DagUsingEquivalencesRec(BinaryDrag<conact>::node *n, BinaryDrag<conact>& t, std::map<BinaryDrag<conact>::node*, bool> &visited_n, bool considering_leaves) {
-	std::map<BinaryDrag<conact>::node*, bool> visited_fl;
-	
-	if (!n->isleaf() || considering_leaves) {
-		FindAndLinkEquivalencesDagRec(n, t.GetRoot(), visited_fl);
+	void VisitRec(node* n) {
+		if (n->isleaf()) {
+			if (considering_leaves_) {
+				for (size_t a = 0; a < n->data.action.size(); ++a) {
+					if (n->data.action[a]) {
+						Link(n, Key(shape_[n], a));
+					}
+				}
+			}
+		}
+		else {
+			Link(n, Key(shape_[n]));
+		}
+		visited_.insert(n);
+
+		if (!n->isleaf()) {
+			if (visited_.find(n->left) == visited_.end())
+				VisitRec(n->left);
+			if (visited_.find(n->right) == visited_.end())
+				VisitRec(n->right);
+		}
 	}
-	visited_n[n] = true;
 
-	if (!n->isleaf()) {
-		if (!visited_n[n->left])
-			Dag2DagUsingEquivalencesRec(n->left, t, visited_n, considering_leaves);
-		if (!visited_n[n->right])
-			Dag2DagUsingEquivalencesRec(n->right, t, visited_n, considering_leaves);
+public:
+	Dag2DagUsingEquivalencesImpl(BinaryDrag<conact>& t, bool considering_leaves) : considering_leaves_{ considering_leaves } {
+		ShapeRec(t.GetRoot());
+		refs_[t.GetRoot()] = 1;
+		VisitRec(t.GetRoot());
 	}
-}
+};
 
 // Converts dag to dag using equivalences between subtrees
 void Dag2DagUsingEquivalences(BinaryDrag<conact>& t, bool considering_leaves) {
-	std::map<BinaryDrag<conact>::node*, bool> visited_n;
-	Dag2DagUsingEquivalencesRec(t.GetRoot(), t, visited_n, considering_leaves);
+	Dag2DagUsingEquivalencesImpl{ t, considering_leaves };
 }
 
 // Given a dag with multiple actions on leaves this function generate all possible dags with only one action per leaf
@@ -190,3 +251,150 @@ void Dag2OptimalDag(BinaryDrag<conact>& t) {
 
     BestDagFromList(trees, t);*/
 }
+
+// Candidates of a subtree are the distinct subtrees, with a single action for each leaf, which can be obtained from it.
+// They are hash-consed in an ArenaDrag (results_), so that each of them is an id, and their number of nodes is the one
+// obtained after the removal of equal subtrees. Candidates of a node are built combining those of its children, and the
+// candidates of the root are all the dags which can be obtained from the tree, so the smallest one is the optimal dag.
+// Subtrees of the input which are equal (considering all the actions of leaves) have the same candidates, which are
+// computed only once. Leaves reached by multiple paths of the input are considered independently for each path.
+//
+// Only the smallest max_candidates candidates of each subtree are kept, and pairs of candidates of the children which
+// can't produce one of them are not combined. Every dag containing a discarded candidate has at least its nodes and
+// leaves, so the result is still optimal if it is not larger than the smallest discarded candidate.
+class Dag2OptimalDagBottomUpImpl {
+	using node = BinaryDrag<conact>::node;
+	using Size = std::pair<uint, uint>; // (nodes, leaves), compared lexicographically
+
+	struct Candidate {
+		ArenaDrag::id id;
+		Size size;
+	};
+
+	ArenaDrag subtrees_; // Hash-consed subtrees of the input, to find equal ones
+	ArenaDrag results_;  // Hash-consed candidates
+	std::unordered_map<const node*, ArenaDrag::id> subtree_;
+	std::unordered_map<ArenaDrag::id, std::vector<Candidate>> candidates_; // Subtree of the input -> candidates
+	std::vector<uint32_t> stamp_;
+	uint32_t cur_stamp_ = 0;
+	size_t max_candidates_;
+	Size min_discarded_{ std::numeric_limits<uint>::max(), std::numeric_limits<uint>::max() };
+
+	// Counts the nodes and leaves reachable from a candidate
+	Size Count(ArenaDrag::id id) {
+		stamp_.resize(results_.size(), 0);
+		++cur_stamp_;
+		Size s{ 0, 0 };
+		std::vector<ArenaDrag::id> stack{ id };
+		while (!stack.empty()) {
+			ArenaDrag::id i = stack.back();
+			stack.pop_back();
+			if (stamp_[i] == cur_stamp_) {
+				continue;
+			}
+			stamp_[i] = cur_stamp_;
+			const ArenaDrag::Node& n = results_.node(i);
+			if (n.isleaf()) {
+				++s.second;
+			}
+			else {
+				++s.first;
+				stack.push_back(n.left);
+				stack.push_back(n.right);
+			}
+		}
+		return s;
+	}
+
+	void Discard(const Size& s) {
+		min_discarded_ = std::min(min_discarded_, s);
+	}
+
+	ArenaDrag::id SubtreeRec(const node* n) {
+		auto it = subtree_.find(n);
+		if (it != subtree_.end()) {
+			return it->second;
+		}
+		ArenaDrag::id id;
+		if (n->isleaf()) {
+			id = subtrees_.MakeLeaf(n->data.action, n->data.next);
+		}
+		else {
+			auto l = SubtreeRec(n->left);
+			auto r = SubtreeRec(n->right);
+			id = subtrees_.MakeNode(n->data.condition, l, r);
+		}
+		return subtree_[n] = id;
+	}
+
+	const std::vector<Candidate>& CandidatesRec(const node* n) {
+		ArenaDrag::id subtree = SubtreeRec(n);
+		auto it = candidates_.find(subtree);
+		if (it != candidates_.end()) {
+			return it->second;
+		}
+
+		std::vector<Candidate> c;
+		if (n->isleaf()) {
+			for (uint a : n->data.actions()) {
+				std::bitset<131/*CTBE needs 131 bits*/> bs;
+				bs.set(a - 1);
+				c.push_back({ results_.MakeLeaf(bs, n->data.next), { 0, 1 } });
+			}
+		}
+		else {
+			const auto& l = CandidatesRec(n->left);
+			const auto& r = CandidatesRec(n->right);
+			uint32_t condition = results_.InternCondition(n->data.condition);
+			std::unordered_set<ArenaDrag::id> found;
+			std::priority_queue<Size> kept; // Sizes of the smallest max_candidates_ candidates found so far
+			// Candidates of the children are sorted by size, and a combination has more nodes than both of them
+			for (const auto& lc : l) {
+				if (kept.size() == max_candidates_ && lc.size.first + 1 > kept.top().first) {
+					Discard({ lc.size.first + 1, 0 });
+					break;
+				}
+				for (const auto& rc : r) {
+					Size bound{ std::max(lc.size.first, rc.size.first) + 1, std::max(lc.size.second, rc.size.second) };
+					if (kept.size() == max_candidates_ && bound > kept.top()) {
+						Discard(bound);
+						if (bound.first > kept.top().first) {
+							break;
+						}
+						continue;
+					}
+					Candidate x{ results_.MakeNode(condition, lc.id, rc.id), {} };
+					if (found.insert(x.id).second) {
+						x.size = Count(x.id);
+						c.push_back(x);
+						kept.push(x.size);
+						if (kept.size() > max_candidates_) {
+							kept.pop();
+						}
+					}
+				}
+			}
+		}
+
+		std::stable_sort(c.begin(), c.end(), [](const Candidate& a, const Candidate& b) { return a.size < b.size; });
+		if (c.size() > max_candidates_) {
+			Discard(c[max_candidates_].size);
+			c.resize(max_candidates_);
+		}
+		return candidates_[subtree] = std::move(c);
+	}
+
+public:
+	bool optimal_;
+
+	Dag2OptimalDagBottomUpImpl(BinaryDrag<conact>& t, size_t max_candidates) : max_candidates_{ std::max<size_t>(max_candidates, 1) } {
+		const auto& c = CandidatesRec(t.GetRoot());
+		optimal_ = c.front().size <= min_discarded_;
+		results_.AddRoot(c.front().id);
+		t = results_.ToBinaryDrag();
+	}
+};
+
+bool Dag2OptimalDagBottomUp(BinaryDrag<conact>& t, size_t max_candidates) {
+	return Dag2OptimalDagBottomUpImpl{ t, max_candidates }.optimal_;
+}
@@ -20,4 +20,11 @@ void Dag2DagUsingEquivalences(BinaryDrag<conact>& t, bool considering_leaves = t
 // USES NUMBER OF NODES TO PICK THE OPTIMAL DAG
 void Dag2OptimalDag(BinaryDrag<conact>& t);
 
+// Converts a tree into dag minimizing the number of nodes and then of leaves, like Dag2OptimalDag, but choosing the actions
+// of leaves bottom-up instead of enumerating all their combinations: for each subtree, the distinct subtrees which can be
+// obtained choosing the actions of its leaves are computed from those of its children, and shared between equal subtrees.
+// At most max_candidates subtrees (the smallest ones) are kept for each subtree: the function returns whether the limit
+// has never been reached, i.e. whether the result is optimal.
+bool Dag2OptimalDagBottomUp(BinaryDrag<conact>& t, size_t max_candidates = 64);
+
 #endif // !GRAPHGEN_DRAG2OPTIMAL_H_
\ No newline at end of file
@@ -0,0 +1,694 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "drag_compressor.h"
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "conact_drag_file.h"
+#include "pool.h"
+#include "yaml-cpp/yaml.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace std::filesystem;
+
+// The checkpoint of a forest is identified by the DRAG to be compressed and by the parameters which affect the result
+static string CheckpointName(const BinaryDrag<conact>& bd, bool ignore_leaves, int iterations) {
+    auto k = TranspositionTable::DragKey(bd);
+    char s[33];
+    snprintf(s, sizeof(s), "%016llx%016llx", static_cast<unsigned long long>(k.h1), static_cast<unsigned long long>(k.h2));
+    string name = s;
+    if (!ignore_leaves) {
+        name += "_leaves";
+    }
+    if (iterations != -1) {
+        name += "_it" + to_string(iterations);
+    }
+    return name;
+}
+
+// Writes a file through a temporary one, so that an interrupted process never leaves a partial file
+template <typename F>
+static bool WriteAtomically(const path& filename, F write) {
+    path tmp_filename = filename;
+    tmp_filename += ".tmp";
+    error_code ec;
+    if (!write(tmp_filename)) {
+        filesystem::remove(tmp_filename, ec);
+        return false;
+    }
+    filesystem::rename(tmp_filename, filename, ec);
+    if (ec) {
+        filesystem::remove(tmp_filename, ec);
+        return false;
+    }
+    return true;
+}
+
+// Best known results of the compression of forests (see CheckpointName), shared by all the algorithms
+static path BestKnownFilename() {
+    return conf.global_output_path_ / "drag_compressor_best_known.yaml";
+}
+
+// Returns the best known result of a compressed forest (if any) and, when record is true, records the number of
+// nodes of the forest. Forests compressed concurrently share the file, which is thus updated under a lock. Malformed
+// results are skipped with a warning
+static optional<pair<size_t, bool>> UpdateBestKnown(const string& name, size_t nodes, bool exhaustive, bool record, ostream& log) {
+    static mutex m;
+    lock_guard<mutex> lock(m);
+
+    YAML::Node results;
+    try {
+        if (exists(BestKnownFilename())) {
+            results = YAML::LoadFile(BestKnownFilename().string());
+        }
+    }
+    catch (...) {
+        log << "WARNING: unable to load the best known DRAG compressions '" << BestKnownFilename().string() << "'.\n";
+        return nullopt;
+    }
+
+    optional<pair<size_t, bool>> best;
+    try {
+        if (results[name]) {
+            best = make_pair(results[name]["nodes"].as<size_t>(), results[name]["exhaustive"].as<bool>());
+        }
+    }
+    catch (...) {
+        log << "WARNING: malformed best known compression of this forest in '" << BestKnownFilename().string() << "', skipped.\n";
+    }
+    if (record && (!best || nodes < best->first || (nodes == best->first && exhaustive && !best->second))) {
+        results[name]["nodes"] = nodes;
+        results[name]["exhaustive"] = exhaustive;
+        error_code ec;
+        create_directories(BestKnownFilename().parent_path(), ec);
+        bool ok = WriteAtomically(BestKnownFilename(), [&](const path& p) {
+            std::ofstream os(p);
+            os << results << "\n";
+            return static_cast<bool>(os);
+        });
+        if (!ok) {
+            log << "WARNING: unable to save the best known DRAG compressions '" << BestKnownFilename().string() << "'.\n";
+        }
+    }
+    return best;
+}
+
+// Checkpoints in use by the forests which are being compressed. Equal forests compressed concurrently would
+// write the same files, so only the first one is checkpointed
+class CheckpointLock {
+    static mutex m_;
+    static set<path> locked_;
+    path checkpoint_;
+public:
+    bool Lock(const path& checkpoint) {
+        lock_guard<mutex> lock(m_);
+        if (!locked_.insert(checkpoint).second) {
+            return false;
+        }
+        checkpoint_ = checkpoint;
+        return true;
+    }
+    ~CheckpointLock() {
+        if (!checkpoint_.empty()) {
+            lock_guard<mutex> lock(m_);
+            locked_.erase(checkpoint_);
+        }
+    }
+};
+mutex CheckpointLock::m_;
+set<path> CheckpointLock::locked_;
+
+void DragCompressor::CompressForest(BinaryDrag<conact>& bd, DragCompressorFlags flags) {
+    RemoveEqualSubtrees{ bd };
+    ResetBest();
+    ResetIterations();
+    progress_counter_ = 0;
+
+    interrupted_ = false;
+    deadline_ = steady_clock::time_point::max();
+    if (conf.drag_compressor_time_budget_ > 0) {
+        deadline_ = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(conf.drag_compressor_time_budget_));
+    }
+
+    bool heuristic = flags & (DragCompressorFlags::BEAM_SEARCH | DragCompressorFlags::SIMULATED_ANNEALING);
+    string name = CheckpointName(bd, flags & DragCompressorFlags::IGNORE_LEAVES, -1);
+    rng_.seed(conf.drag_compressor_seed_);
+
+    path_.clear();
+    resume_path_.clear();
+    stop_path_.clear();
+    checkpoint_.clear();
+    CheckpointState state = CheckpointState::NONE;
+    CheckpointLock checkpoint_lock;
+    path checkpoint = conf.drag_compressor_checkpoint_path_ / CheckpointName(bd, flags & DragCompressorFlags::IGNORE_LEAVES, iterations_max_);
+    // Heuristic searches are short, and not resumable
+    if (conf.drag_compressor_checkpoints_ && !heuristic && checkpoint_lock.Lock(checkpoint)) {
+        checkpoint_ = checkpoint;
+        state = LoadCheckpoint(bd);
+        if (state == CheckpointState::COMPLETED) {
+            os_ << "Compressed DRAG loaded from checkpoint '" << checkpoint_.string() << "'.\n";
+            return;
+        }
+        if (state == CheckpointState::RESUMED) {
+            os_ << "Compression resumed from checkpoint '" << checkpoint_.string() << "'.\n";
+        }
+        next_checkpoint_ = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(conf.drag_compressor_checkpoint_interval_));
+    }
+
+    do {
+        // A resumed search continues the round of the checkpoint
+        if (state != CheckpointState::RESUMED) {
+            changes_ = false;
+            if (!checkpoint_.empty()) {
+                SaveRoundStart(bd);
+            }
+        }
+        state = CheckpointState::NONE;
+
+        DragOptimizer(bd, flags);
+        resume_path_.clear();
+        // Nothing better has been found if the search has been interrupted before reaching any of its leaves
+        if (best_nodes_ != numeric_limits<size_t>::max()) {
+            bd = best_bd_;
+        }
+        ResetIterations();
+    } while (changes_ && !interrupted_);
+
+    if (!checkpoint_.empty()) {
+        SaveCheckpoint(stop_path_, !interrupted_, &bd);
+    }
+
+    // The result of a complete exhaustive search is the best one (apart from early stopping), the gap of the
+    // heuristic ones is measured from the best result known for the same forest. Results are only recorded if
+    // enabled in the configuration (drag_compressor best_known)
+    if (heuristic || conf.drag_compressor_best_known_) {
+        size_t nodes = BinaryDragStatistics(bd).Nodes();
+        auto best = UpdateBestKnown(name, nodes, !heuristic && !interrupted_ && !early_stopping_active_, conf.drag_compressor_best_known_, os_);
+        if (heuristic) {
+            os_ << "\rHeuristic DRAG compression: " << nodes << " nodes";
+            if (best) {
+                char gap[32];
+                snprintf(gap, sizeof(gap), "%+.2f%%", 100. * (static_cast<double>(nodes) - best->first) / best->first);
+                os_ << " (best known: " << best->first << (best->second ? ", by exhaustive search" : "") << "; gap: " << gap << ")";
+            }
+            else {
+                os_ << " (no known result for this forest)";
+            }
+            os_ << ".\n";
+        }
+    }
+
+    if (interrupted_) {
+        os_ << "WARNING: time budget of the DRAG compression exhausted, the compressed DRAG may not be the best one";
+        if (!checkpoint_.empty()) {
+            os_ << " (the compression will be resumed from checkpoint '" << checkpoint_.string() << "')";
+        }
+        os_ << ".\n";
+    }
+}
+
+DragCompressor::CheckpointState DragCompressor::LoadCheckpoint(BinaryDrag<conact>& bd) {
+    path state_filename = checkpoint_;
+    state_filename += ".yaml";
+    if (!exists(state_filename)) {
+        return CheckpointState::NONE;
+    }
+
+    path dir = checkpoint_.parent_path();
+    try {
+        YAML::Node state = YAML::LoadFile(state_filename.string());
+        checkpoint_seq_ = state["seq"].as<size_t>();
+        if (state["completed"].as<bool>()) {
+            BinaryDrag<conact> result;
+            if (!LoadConactDragBinary(result, (dir / state["result"].as<string>()).string())) {
+                throw runtime_error("missing result");
+            }
+            bd = move(result);
+            return CheckpointState::COMPLETED;
+        }
+
+        BinaryDrag<conact> start;
+        round_start_filename_ = state["start"].as<string>();
+        if (!LoadConactDragBinary(start, (dir / round_start_filename_).string())) {
+            throw runtime_error("missing round start");
+        }
+        if (state["best"]) {
+            if (!LoadConactDragBinary(best_bd_, (dir / state["best"].as<string>()).string())) {
+                throw runtime_error("missing best DRAG");
+            }
+            best_nodes_ = state["best_nodes"].as<size_t>();
+            best_leaves_ = state["best_leaves"].as<size_t>();
+        }
+        progress_counter_ = state["progress_counter"].as<size_t>();
+        iterations_left_ = state["iterations_left"].as<int>();
+        changes_ = state["changes"].as<bool>();
+        resume_path_ = state["path"].as<vector<uint32_t>>();
+        bd = move(start);
+    }
+    catch (...) {
+        os_ << "WARNING: unable to load the DRAG compression checkpoint '" << checkpoint_.string() << "', the compression restarts.\n";
+        ResetBest();
+        ResetIterations();
+        progress_counter_ = 0;
+        resume_path_.clear();
+        return CheckpointState::NONE;
+    }
+    return CheckpointState::RESUMED;
+}
+
+void DragCompressor::SaveRoundStart(const BinaryDrag<conact>& bd) {
+    round_start_filename_ = checkpoint_.filename().string() + ".start_" + to_string(checkpoint_seq_++) + ".bin";
+    path filename = checkpoint_.parent_path() / round_start_filename_;
+    error_code ec;
+    create_directories(checkpoint_.parent_path(), ec);
+    if (!WriteAtomically(filename, [&](const path& p) { return WriteConactDragBinary(bd, p.string()); })) {
+        os_ << "WARNING: unable to save the DRAG compression checkpoint '" << checkpoint_.string() << "'.\n";
+        return;
+    }
+    SaveCheckpoint({}, false);
+}
+
+void DragCompressor::SaveCheckpoint(const vector<uint32_t>& path, bool completed, const BinaryDrag<conact>* result) {
+    next_checkpoint_ = steady_clock::now() + duration_cast<steady_clock::duration>(duration<double>(conf.drag_compressor_checkpoint_interval_));
+
+    string name = checkpoint_.filename().string();
+    filesystem::path dir = checkpoint_.parent_path();
+    auto write_drag = [&](const BinaryDrag<conact>& t, const string& kind) {
+        string filename = name + "." + kind + "_" + to_string(checkpoint_seq_++) + ".bin";
+        if (!WriteAtomically(dir / filename, [&](const filesystem::path& p) { return WriteConactDragBinary(t, p.string()); })) {
+            throw runtime_error("unable to write " + filename);
+        }
+        return filename;
+    };
+
+    YAML::Node state;
+    set<string> files;
+    try {
+        state["completed"] = completed;
+        if (completed) {
+            string filename = write_drag(*result, "result");
+            files.insert(filename);
+            state["result"] = filename;
+        }
+        else {
+            files.insert(round_start_filename_);
+            state["start"] = round_start_filename_;
+            if (best_nodes_ != numeric_limits<size_t>::max()) {
+                string best = write_drag(best_bd_, "best");
+                files.insert(best);
+                state["best"] = best;
+                state["best_nodes"] = best_nodes_;
+                state["best_leaves"] = best_leaves_;
+            }
+            state["progress_counter"] = progress_counter_;
+            state["iterations_left"] = iterations_left_;
+            state["changes"] = changes_;
+            state["path"] = path;
+        }
+        state["seq"] = checkpoint_seq_;
+    }
+    catch (const runtime_error&) {
+        os_ << "WARNING: unable to save the DRAG compression checkpoint '" << checkpoint_.string() << "'.\n";
+        return;
+    }
+
+    filesystem::path state_filename = checkpoint_;
+    state_filename += ".yaml";
+    bool ok = WriteAtomically(state_filename, [&](const filesystem::path& p) {
+        std::ofstream os(p);
+        YAML::Emitter emitter(os);
+        emitter.SetSeqFormat(YAML::EMITTER_MANIP::Flow);
+        emitter << state;
+        return static_cast<bool>(os);
+    });
+    if (!ok) {
+        os_ << "WARNING: unable to save the DRAG compression checkpoint '" << checkpoint_.string() << "'.\n";
+        return;
+    }
+
+    // Remove the files of the previous checkpoints
+    files.insert(state_filename.filename().string());
+    vector<filesystem::path> old_files;
+    error_code ec;
+    for (const auto& entry : directory_iterator(dir, ec)) {
+        string filename = entry.path().filename().string();
+        if (filename.rfind(name + ".", 0) == 0 && files.count(filename) == 0) {
+            old_files.push_back(entry.path());
+        }
+    }
+    for (const auto& f : old_files) {
+        filesystem::remove(f, ec);
+    }
+}
+
+void DragCompressor::HeuristicLeaf(const BinaryDrag<conact>& bd, size_t nodes, DragCompressorFlags flags) {
+    ++progress_counter_;
+    if ((flags & DragCompressorFlags::PRINT_STATUS_BAR) && progress_counter_ % 1000 == 0) {
+        os_ << "\r" << progress_counter_ << SearchStatus() << std::flush;
+    }
+    if (nodes < best_nodes_) {
+        BinaryDrag<conact> leaf(bd);
+        UpdateBest(leaf, flags);
+    }
+}
+
+void DragCompressor::BeamSearch(BinaryDrag<conact>& bd, DragCompressorFlags flags) {
+    bool ignore_leaves = flags & DragCompressorFlags::IGNORE_LEAVES;
+    size_t width = max<size_t>(conf.drag_compressor_beam_width_, 1);
+
+    // The same DRAG is expanded only once, even if reached from different DRAGs of the beam. The table is
+    // cleared, because the DRAGs explored by the previous rounds have not been completely explored
+    explored_.Clear();
+
+    // Level by level, all the merges of the DRAGs of the beam are performed and the width DRAGs with less
+    // nodes are kept (in the order of the exhaustive search, for the same number of nodes)
+    vector<SearchDrag> beam;
+    beam.emplace_back(bd);
+    while (!beam.empty() && !TimeOut()) {
+        vector<pair<size_t, SearchDrag>> next;
+        for (auto& cur : beam) {
+            size_t bound = conf.drag_compressor_pruning_ ? best_nodes_ : numeric_limits<size_t>::max();
+            Merges m = FindMerges(cur, ignore_leaves, bound);
+            if (m.expansion == Expansion::PRUNED) {
+                ++pruned_;
+            }
+            else if (m.expansion == Expansion::LEAF) {
+                HeuristicLeaf(cur.bd, BinaryDragStatistics(cur.bd).Nodes(), flags);
+            }
+            for (const auto& [a, b] : m.pairs) {
+                SearchDrag child = Merge(cur, a, b);
+                if (!explored_.Visited(TranspositionTable::DragKey(child.bd))) {
+                    size_t nodes = BinaryDragStatistics(child.bd).Nodes();
+                    next.emplace_back(nodes, move(child));
+                }
+            }
+        }
+
+        stable_sort(begin(next), end(next), [](const auto& a, const auto& b) { return a.first < b.first; });
+        beam.clear();
+        for (size_t i = 0; i < next.size() && i < width; ++i) {
+            beam.push_back(move(next[i].second));
+        }
+    }
+}
+
+void DragCompressor::SimulatedAnnealing(BinaryDrag<conact>& bd, DragCompressorFlags flags) {
+    bool ignore_leaves = flags & DragCompressorFlags::IGNORE_LEAVES;
+
+    // A solution is a sequence of merges, stored as the DRAGs it goes through: each one is obtained from the
+    // previous one with a merge, and the last one has no equivalent subtrees. Solutions share their prefixes.
+    // Only the DRAGs are stored: the statistics are collected on the last DRAG of the shared prefix, and then
+    // updated by the merges
+    using Solution = vector<shared_ptr<BinaryDrag<conact>>>;
+    auto RandomMerges = [&](Solution& s) {
+        SearchDrag cur(*s.back());
+        while (true) {
+            Merges m = FindMerges(cur, ignore_leaves, numeric_limits<size_t>::max());
+            if (m.pairs.empty()) {
+                return BinaryDragStatistics(cur.bd).Nodes();
+            }
+            const auto& [a, b] = m.pairs[uniform_int_distribution<size_t>(0, m.pairs.size() - 1)(rng_)];
+            cur = Merge(cur, a, b);
+            s.push_back(make_shared<BinaryDrag<conact>>(cur.bd));
+        }
+    };
+
+    Solution current{ make_shared<BinaryDrag<conact>>(bd) };
+    size_t current_nodes = RandomMerges(current);
+    HeuristicLeaf(*current.back(), current_nodes, flags);
+
+    // A neighbour of the current solution keeps its merges up to a random level, and continues with random
+    // ones. Worse neighbours are accepted with a probability which decreases with the temperature
+    double temperature = conf.drag_compressor_temperature_;
+    for (size_t i = 0; i < conf.drag_compressor_annealing_iterations_ && current.size() > 1 && !TimeOut(); ++i) {
+        size_t level = uniform_int_distribution<size_t>(0, current.size() - 2)(rng_);
+        Solution neighbour(begin(current), begin(current) + level + 1);
+        size_t nodes = RandomMerges(neighbour);
+        HeuristicLeaf(*neighbour.back(), nodes, flags);
+
+        double p = uniform_real_distribution<double>(0, 1)(rng_);
+        if (nodes <= current_nodes || (temperature > 0 && p < exp((static_cast<double>(current_nodes) - nodes) / temperature))) {
+            current = move(neighbour);
+            current_nodes = nodes;
+        }
+        temperature *= conf.drag_compressor_cooling_;
+    }
+}
+
+size_t DragCompressor::SearchThreads() const {
+    if (early_stopping_active_ || !checkpoint_.empty()) {
+        return 1;
+    }
+    size_t nthreads = conf.drag_compressor_threads_;
+    if (nthreads == 0) {
+        nthreads = max(thread::hardware_concurrency(), 1u);
+    }
+    return min(nthreads, max_search_threads_);
+}
+
+namespace {
+
+// Node of the search over merges. The path stores the index of the merge chosen at each level, so that
+// comparing paths lexicographically gives the order in which the serial search visits the nodes.
+struct SearchNode {
+    DragCompressor::SearchDrag s;
+    vector<uint32_t> path;
+};
+
+// Double-ended queue of a worker: the owner pushes and pops at the back (depth-first), the other
+// workers steal from the front, where the largest subtrees of the search are.
+struct WorkQueue {
+    mutex m;
+    deque<SearchNode> q;
+
+    void push(SearchNode&& n) {
+        lock_guard<mutex> lock(m);
+        q.push_back(move(n));
+    }
+
+    bool pop(SearchNode& n) {
+        lock_guard<mutex> lock(m);
+        if (q.empty()) {
+            return false;
+        }
+        n = move(q.back());
+        q.pop_back();
+        return true;
+    }
+
+    bool steal(SearchNode& n) {
+        lock_guard<mutex> lock(m);
+        if (q.empty()) {
+            return false;
+        }
+        n = move(q.front());
+        q.pop_front();
+        return true;
+    }
+};
+
+// Leaves of the search which may be selected by the serial search, sorted by path.
+//
+// The serial search replaces the best DRAG with a leaf only if the leaf has less nodes than the current
+// best one, and after visiting a leaf the best DRAG never has more nodes than the leaf. Thus a leaf
+// can be selected only if it has less nodes than all the leaves visited before it (and than the best
+// DRAG of the previous rounds): only these leaves are kept, so that the serial selection can be
+// replayed on them once the search ends. Their number of nodes is strictly decreasing with the path.
+class Candidates {
+    mutex m_;
+    map<vector<uint32_t>, pair<size_t, BinaryDrag<conact>>> c_;
+    const size_t bound_;
+
+public:
+    Candidates(size_t bound) : bound_{ bound } {}
+
+    void Add(SearchNode&& n, size_t nodes) {
+        if (nodes >= bound_) {
+            return;
+        }
+        lock_guard<mutex> lock(m_);
+        auto it = c_.lower_bound(n.path);
+        if (it != c_.begin() && prev(it)->second.first <= nodes) {
+            return;
+        }
+        while (it != c_.end() && it->second.first >= nodes) {
+            it = c_.erase(it);
+        }
+        c_.emplace_hint(it, move(n.path), make_pair(nodes, move(n.s.bd)));
+    }
+
+    // Returns the number of nodes a leaf of the search reached from path must be below to be selected
+    size_t Bound(const vector<uint32_t>& path) {
+        lock_guard<mutex> lock(m_);
+        auto it = c_.lower_bound(path);
+        return it == c_.begin() ? bound_ : prev(it)->second.first;
+    }
+
+    map<vector<uint32_t>, pair<size_t, BinaryDrag<conact>>>& get() { return c_; }
+};
+
+}
+
+void DragCompressor::ParallelDragOptimizer(BinaryDrag<conact>& bd, DragCompressorFlags flags) {
+    bool print_status_bar = flags & DragCompressorFlags::PRINT_STATUS_BAR;
+    bool ignore_leaves = flags & DragCompressorFlags::IGNORE_LEAVES;
+
+    size_t nthreads = SearchThreads();
+    vector<WorkQueue> queues(nthreads);
+    Candidates candidates(best_nodes_);
+    atomic<size_t> pending = 1; // Nodes of the search pushed and not yet expanded
+    atomic<size_t> leaves = 0;
+    mutex log_mutex;
+
+    // Workers which find no node to steal wait on work, which is signalled when nodes which can be stolen are
+    // pushed and when the search ends. The generation is incremented at each signal, so that a worker waits only
+    // if nothing has been pushed since it started looking for nodes
+    mutex idle_mutex;
+    condition_variable work;
+    size_t generation = 0;      // Guarded by idle_mutex
+    atomic<size_t> idle = 0;    // Workers looking for nodes to steal or waiting for them
+    auto signal = [&]() {
+        lock_guard<mutex> lock(idle_mutex);
+        ++generation;
+        work.notify_all();
+    };
+    // Marks a node as expanded
+    auto expanded = [&]() {
+        if (--pending == 0) {
+            signal();
+        }
+    };
+
+    queues[0].push({ DragCompressor::SearchDrag(bd), {} });
+
+    auto worker = [&](size_t id) {
+        SearchNode n;
+        while (pending > 0) {
+            bool found = queues[id].pop(n);
+            if (!found) {
+                // The worker is idle before stealing, so nodes pushed after a failed steal always signal it
+                size_t g;
+                {
+                    lock_guard<mutex> lock(idle_mutex);
+                    g = generation;
+                }
+                ++idle;
+                for (size_t i = 1; !found && i < nthreads; ++i) {
+                    found = queues[(id + i) % nthreads].steal(n);
+                }
+                if (!found) {
+                    unique_lock<mutex> lock(idle_mutex);
+                    work.wait(lock, [&] { return generation != g || pending == 0; });
+                }
+                --idle;
+                if (!found) {
+                    continue;
+                }
+            }
+            if (TimeOut()) {
+                // Drop the remaining nodes, the leaves found so far are used anyway
+                expanded();
+                continue;
+            }
+            if (explored_.Visited(TranspositionTable::DragKey(n.s.bd), n.path)) {
+                expanded();
+                continue;
+            }
+
+            // Children are pushed in reverse order, so that the owner visits them in the serial order
+            vector<SearchNode> children;
+            uint32_t k = 0;
+            size_t bound = conf.drag_compressor_pruning_ ? candidates.Bound(n.path) : numeric_limits<size_t>::max();
+            Expansion e = ForEachMerge(n.s, ignore_leaves, bound, 0, [&](SearchDrag& child) {
+                vector<uint32_t> path = n.path;
+                path.push_back(k++);
+                children.push_back({ move(child), move(path) });
+            });
+            pending += children.size();
+            for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                queues[id].push(move(*it));
+            }
+            // The first child is popped by the owner, the others can be stolen
+            if (children.size() > 1 && idle > 0) {
+                signal();
+            }
+
+            if (e == Expansion::PRUNED) {
+                ++pruned_;
+            }
+            else if (e == Expansion::LEAF) {
+                size_t counter = ++leaves;
+                if (print_status_bar && counter % 1000 == 0) {
+                    lock_guard<mutex> lock(log_mutex);
+                    os_ << "\r" << progress_counter_ + counter << SearchStatus() << flush;
+                }
+                size_t nodes = BinaryDragStatistics(n.s.bd).Nodes();
+                candidates.Add(move(n), nodes);
+            }
+            expanded();
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t i = 0; i < nthreads; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Replay the serial selection on the leaves which may be selected
+    progress_counter_ += leaves;
+    for (auto& [path, c] : candidates.get()) {
+        UpdateBest(c.second, flags);
+    }
+}
+
+void DragCompressor::Compress(vector<Forest>& forests, int iterations, DragCompressorFlags flags) {
+    size_t nthreads = conf.drag_compressor_forest_threads_;
+    if (nthreads == 0) {
+        nthreads = max(thread::hardware_concurrency(), 1u);
+    }
+    nthreads = min(nthreads, forests.size());
+
+    if (nthreads <= 1) {
+        for (const auto& f : forests) {
+            DragCompressor dc(iterations);
+            dc.CompressAndLog(f, flags);
+        }
+        return;
+    }
+
+    // Each forest is compressed by its own single-threaded DragCompressor, which logs on a buffer without status
+    // bar updates. The log of a forest is printed as soon as the forest and all the previous ones have been compressed
+    vector<ostringstream> logs(forests.size());
+    thread_pool pool(static_cast<unsigned>(forests.size()), nthreads);
+    vector<future<void>> compressed;
+    for (size_t i = 0; i < forests.size(); ++i) {
+        compressed.push_back(pool.enqueue_task([&, i]() {
+            DragCompressor dc(iterations, logs[i], 1);
+            dc.CompressAndLog(forests[i], flags, true);
+        }));
+    }
+    for (size_t i = 0; i < forests.size(); ++i) {
+        compressed[i].get();
+        std::cout << logs[i].str() << std::flush;
+    }
+}
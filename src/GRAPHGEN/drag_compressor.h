@@ -8,7 +8,13 @@
 #define GRAPHGEN_DRAG_COMPRESSOR_H_
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <random>
 #include <set>
 #include <unordered_set>
 
@@ -20,6 +26,7 @@
 #include "forest2dag.h"
 #include "forest_statistics.h"
 #include "graph_code_generator.h"
+#include "transposition_table.h"
 
 /*BinaryDrag<conact>::node* MergeEquivalentTreesRec(BinaryDrag<conact>::node* a, BinaryDrag<conact>::node* b, std::unordered_map<BinaryDrag<conact>::node*, BinaryDrag<conact>::node*> &merged)
     {
@@ -133,6 +140,7 @@ class MergeLeaves {
 private:
     std::unordered_set<BinaryDrag<conact>::node*> visited_nodes_;
     std::unordered_set<BinaryDrag<conact>::node*> visited_leaves_;
+    std::vector<BinaryDrag<conact>::node*> leaves_; // Visited leaves in visit order
     std::unordered_map<BinaryDrag<conact>::node*, std::vector<BinaryDrag<conact>::node*>> parents_;
     BinaryDrag<conact>& bd_;
 public:
@@ -147,7 +155,9 @@ public:
     void CalculateStatsRec(BinaryDrag<conact>::node*& n) {
 
         if (n->isleaf()) {
-            visited_leaves_.insert(n);
+            if (visited_leaves_.insert(n).second) {
+                leaves_.push_back(n);
+            }
             return;
         }
 
@@ -161,7 +171,7 @@ public:
     }
     
     void SerializeVisitedLeaves(std::ostream& os = std::cout) {
-        for (const auto& l : visited_leaves_) {
+        for (const auto& l : leaves_) {
             for (const auto& a : l->data.actions()) {
                 os << a;
             }
@@ -173,7 +183,7 @@ public:
 
         std::unordered_set<BinaryDrag<conact>::node*> already_updated; // Store the leaves for which the parents have already been updated
         // For each actually used leaf
-        for(auto& i : visited_leaves_){
+        for(auto& i : leaves_){
             // Skip multiple actions leaves 
             if (i->data.actions().size() != 1 || already_updated.find(i) != end(already_updated)){
                 continue;
@@ -182,7 +192,7 @@ public:
             // Compare the current leaf's action with the actions of all the others leaves 
             // and merge them (updating parents) if there is a non-empty intersection and
             // the next tree ids are the same
-            for (auto& j : visited_leaves_){
+            for (auto& j : leaves_){
                 if(i == j){
                     continue; // We don't want to compare a leaf with itself
                 }
@@ -226,13 +236,47 @@ DEFINE_ENUM_CLASS_FLAGS(DragCompressorFlags,
                                                increase the total execution time without improving the
                                                final compression result in anyway. */
     SAVE_INTERMEDIATE_RESULTS = 4, /**< @brief Whether to delete or not the dot code used to draw the drag */
+    BEAM_SEARCH               = 8, /**< @brief Whether to replace the exhaustive search of merges with a beam
+                                               search, which keeps at each level only the DRAGs with less nodes
+                                               (see drag_compressor beam_width in the configuration) */
+    SIMULATED_ANNEALING       = 16, /**< @brief Whether to replace the exhaustive search of merges with simulated
+                                               annealing over random sequences of merges (see drag_compressor
+                                               annealing_iterations, temperature, cooling and seed in the
+                                               configuration). If combined with BEAM_SEARCH, annealing follows
+                                               the beam search in every round */
 )
 
 //DEFINE_ENUM_CLASS_OR_OPERATOR(DragCompressorFlags)
 //DEFINE_ENUM_CLASS_AND_OPERATOR(DragCompressorFlags)
 
-// Compress a tree / forest into a DRAG solving equivalences
+// Compress a tree / forest into a DRAG solving equivalences. All the sequences of merges of equivalent
+// subtrees are explored, using the number of threads specified in the configuration (drag_compressor
+// threads); the resulting DRAG does not depend on the number of threads. When the exhaustive search is
+// infeasible, a heuristic one can be selected with the BEAM_SEARCH and SIMULATED_ANNEALING flags.
 class DragCompressor {
+public:
+    // A forest to be compressed, together with the message which introduces its log
+    struct Forest {
+        BinaryDrag<conact>* bd;
+        std::string message;
+    };
+
+    // A DRAG reached by the search, with the statistics of its subtrees. Statistics are updated by the merges
+    // which lead from a DRAG to the next one (see Merge), instead of being collected again on every DRAG
+    struct SearchDrag {
+        BinaryDrag<conact> bd;
+        CollectDragStatistics cds;
+
+        SearchDrag() {}
+        SearchDrag(const BinaryDrag<conact>& d) : bd(d), cds(bd) {}
+        SearchDrag(BinaryDrag<conact>&& d) : bd(std::move(d)), cds(bd) {}
+        SearchDrag(BinaryDrag<conact>&& d, CollectDragStatistics&& c) : bd(std::move(d)), cds(std::move(c)) {}
+        // Statistics refer to the nodes of bd, so a copy would need new ones
+        SearchDrag(const SearchDrag&) = delete;
+        SearchDrag(SearchDrag&&) = default;
+        SearchDrag& operator=(SearchDrag&&) = default;
+    };
+
 private:
     bool changes_;
 
@@ -244,30 +288,81 @@ private:
     size_t progress_counter_ = 0;
     size_t best_nodes_ = std::numeric_limits<size_t >::max();
     size_t best_leaves_ = std::numeric_limits<size_t >::max();
+
+    // DRAGs already explored by the search
+    TranspositionTable explored_{ conf.drag_compressor_table_mb_ << 20 };
+    // Nodes of the search cut because they can't lead to a better DRAG
+    std::atomic<size_t> pruned_ = 0;
+
+    // Time budget of the current forest, see CompressForest
+    std::chrono::steady_clock::time_point deadline_;
+    std::atomic<bool> interrupted_ = false;
+
+    // Checkpoints of the current forest (the path is empty when checkpoints are disabled), see CompressForest
+    std::filesystem::path checkpoint_;
+    std::chrono::steady_clock::time_point next_checkpoint_;
+    std::string round_start_filename_;
+    size_t checkpoint_seq_ = 0;
+    std::vector<uint32_t> path_;        // Path (index of the merge chosen at each level) of the current node of the serial search
+    std::vector<uint32_t> resume_path_; // Path of the node from which a resumed search starts, empty otherwise
+    std::vector<uint32_t> stop_path_;   // Path of the first node not visited because of the time budget
+
+    // Random generator of the simulated annealing, seeded for each forest
+    std::mt19937_64 rng_;
+
+    // Log of the compression
+    std::ostream& os_;
+
+    // Maximum number of threads of the search, 1 when the forest is compressed by a pool (see Compress)
+    size_t max_search_threads_;
+
+    DragCompressor(int iterations, std::ostream& os = std::cout, size_t max_search_threads = std::numeric_limits<size_t>::max()) : os_{ os }, max_search_threads_{ max_search_threads } {
+        early_stopping_active_ = iterations != -1;
+        iterations_left_ = iterations_max_ = iterations;
+    }
+
+    // Compresses a forest logging on os_, in the same format of TLOG. When os_ is a buffer (buffered is true), the
+    // updates of the status bar would only pile up in it, so the search doesn't print them and the log just gets
+    // the final counter line
+    void CompressAndLog(const Forest& f, DragCompressorFlags flags, bool buffered = false) {
+        PerformanceEvaluator pe;
+        os_ << f.message << "... ";
+        pe.start();
+        DragCompressorFlags search_flags = flags;
+        if (buffered) {
+            search_flags = static_cast<DragCompressorFlags>(static_cast<uint32_t>(flags) & ~static_cast<uint32_t>(DragCompressorFlags::PRINT_STATUS_BAR));
+        }
+        CompressForest(*f.bd, search_flags);
+        UpdateProgress(flags);
+        os_ << "done. " << pe.stop() << " ms.\n";
+    }
 public:
 
     void UpdateProgress(DragCompressorFlags flags) {
         bool print_status_bar = flags & DragCompressorFlags::PRINT_STATUS_BAR;
         if (print_status_bar) {
-            std::cout << "\r" << progress_counter_ << "\n";
+            os_ << "\r" << progress_counter_ << SearchStatus() << "\n";
+        }
+    }
+
+    // Hits and misses of the table of the explored DRAGs and pruned branches, to be printed in the status bar
+    std::string SearchStatus() const {
+        std::string s;
+        if (explored_.hits() + explored_.misses() > 0) {
+            s += " (explored DRAGs - hits: " + std::to_string(explored_.hits()) + ", misses: " + std::to_string(explored_.misses()) + ")";
         }
+        if (pruned_ > 0) {
+            s += " (pruned: " + std::to_string(pruned_) + ")";
+        }
+        return s;
     }
 
     // BinaryDrag 
     // Iteration is the early stopping criteria and represents the number of "iteration" 
     // after a new optimal is found. -1 means no early stopping and it's the dafult
-    DragCompressor(BinaryDrag<conact>& bd, int iterations = -1, DragCompressorFlags flags = DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES) {
-        early_stopping_active_ = iterations != -1;
-        iterations_left_ = iterations_max_ = iterations;
+    DragCompressor(BinaryDrag<conact>& bd, int iterations = -1, DragCompressorFlags flags = DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES) : DragCompressor(iterations) {
         TLOG("Compressing BinaryDrag",
-            RemoveEqualSubtrees{ bd };
-            do {
-                changes_ = false;
-                FastDragOptimizerRec(bd, flags);
-                bd = best_bd_;
-                ResetIterations();
-            } while (changes_);
-        
+            CompressForest(bd, flags);
             UpdateProgress(flags);
         )
     }
@@ -278,113 +373,155 @@ public:
     }
 
     // LineForestHandler
-    DragCompressor(LineForestHandler& lfh, int iterations = -1, DragCompressorFlags flags = DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES) {
-        early_stopping_active_ = iterations != -1;
-        iterations_left_ = iterations_max_ = iterations;
-        std::string msg = conf.algorithm_name_ + " - compressing main forest\n";
-        TLOG(msg,
-            RemoveEqualSubtrees{ lfh.f_ };
-            do {
-                changes_ = false;
-                FastDragOptimizerRec(lfh.f_, flags);
-                lfh.f_ = best_bd_;
-                ResetIterations();
-            }while(changes_);
-            UpdateProgress(flags);
-        )
+    DragCompressor(LineForestHandler& lfh, int iterations = -1, DragCompressorFlags flags = DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES) : DragCompressor(iterations) {
+        std::vector<Forest> forests;
+        AddForests(forests, lfh);
+        Compress(forests, iterations, flags);
+    }
 
+    // Appends to forests the main forest and the end forests of lfh. The group name, if any, is added to their messages
+    static void AddForests(std::vector<Forest>& forests, LineForestHandler& lfh, const std::string& group = "") {
+        std::string prefix = conf.algorithm_name_ + " - compressing " + (group.empty() ? "" : group + " line ");
+        forests.push_back({ &lfh.f_, prefix + "main forest\n" });
         int fn = 0;
         for (auto& f : lfh.end_forests_) {
-            progress_counter_ = 0;
-            ResetIterations();
-            msg = conf.algorithm_name_ + " - compressing end forest #" + std::to_string(fn++) + "\n";
-            TLOG(msg,
-                RemoveEqualSubtrees{ f };
-                ResetBest();
-                do {
-                    changes_ = false;
-                    FastDragOptimizerRec(f, flags);
-                    f = best_bd_;
-                    ResetIterations();
-                } while (changes_);
-                UpdateProgress(flags);)
+            forests.push_back({ &f, prefix + "end forest #" + std::to_string(fn++) + "\n" });
         }
     }
 
+    // Compresses independent forests, using the number of threads specified in the configuration (drag_compressor
+    // forest_threads). Each forest has its own log, and logs are printed in the order of forests, so that the output
+    // is the same of the serial compression. Forests compressed concurrently are searched by a single thread each,
+    // so that threads don't multiply. See drag_compressor.cpp.
+    static void Compress(std::vector<Forest>& forests, int iterations = -1, DragCompressorFlags flags = DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES);
+
 private:
 
+    // Compresses a single forest (or tree). When the time budget is exhausted the search stops and bd is the best DRAG
+    // found so far. If checkpoints are enabled, the state of the search is periodically saved and an interrupted
+    // search is resumed from the last checkpoint. See drag_compressor.cpp.
+    void CompressForest(BinaryDrag<conact>& bd, DragCompressorFlags flags);
+
+    // Checks the time budget, setting interrupted_ when it is exhausted
+    bool TimeOut() {
+        if (!interrupted_ && std::chrono::steady_clock::now() >= deadline_) {
+            interrupted_ = true;
+        }
+        return interrupted_;
+    }
+
+    enum class CheckpointState {
+        NONE,      // No (valid) checkpoint
+        RESUMED,   // The search has been restored and must be resumed
+        COMPLETED  // The forest has already been compressed
+    };
+
+    // Loads the checkpoint of the current forest, if any, replacing bd with the DRAG from which the search must be resumed
+    // (or with the compressed one)
+    CheckpointState LoadCheckpoint(BinaryDrag<conact>& bd);
+    // Saves the round start DRAG of the search to the current checkpoint
+    void SaveRoundStart(const BinaryDrag<conact>& bd);
+    // Saves the state of the search to the current checkpoint: path is the first node to be visited when resuming
+    void SaveCheckpoint(const std::vector<uint32_t>& path, bool completed, const BinaryDrag<conact>* result = nullptr);
+
     void ResetBest() {
         best_nodes_ = std::numeric_limits<size_t >::max();
         best_leaves_ = std::numeric_limits<size_t >::max();
+        // DRAGs explored in the previous rounds of the same forest can be skipped, since none of the
+        // leaves of the search they lead to can beat the best DRAG. This is not true after a reset.
+        explored_.Clear();
+        pruned_ = 0;
     }
 
-    // This class perform the merge of equivalent trees updating links
-    struct MergeEquivalentTreesAndUpdate {
-        std::unordered_set<BinaryDrag<conact>::node*> visited_;
-        std::unordered_map<BinaryDrag<conact>::node*, std::vector<BinaryDrag<conact>::node*>>& parents_;
-
-        MergeEquivalentTreesAndUpdate(BinaryDrag<conact>::node* a, 
-                                      BinaryDrag<conact>::node* b, 
-                                      std::unordered_map<BinaryDrag<conact>::node*, std::vector<BinaryDrag<conact>::node*>>& parents) :
-            parents_{ parents }
-        {
-            MergeEquivalentTreesAndUpdateRec(a, b);
-        }
-
-        void MergeEquivalentTreesAndUpdateRec(BinaryDrag<conact>::node* a, BinaryDrag<conact>::node* b)
-        {
-            auto it = visited_.find(a);
-            if (it != end(visited_))
-                return;
-            visited_.insert(a);
+    BinaryDrag<conact> best_bd_;
 
-            for (auto& x : parents_[b]) {
-                if (x->left == b)
-                    x->left = a;
-                else
-                    x->right = a;
+    // Returns the number of threads to be used for the search over merges, according to the configuration and to
+    // max_search_threads_. Early stopping depends on the order in which the solutions are found, so it requires a
+    // serial search
+    size_t SearchThreads() const;
+
+    // Returns a lower bound of the number of nodes of every DRAG which can be obtained merging equivalent
+    // subtrees, given all the subtrees of a DRAG (one for each node).
+    //
+    // Merges preserve the structure of conditions of subtrees (structure_), so nodes with different
+    // structures are never merged. Moreover, merging two subtrees restricts their actions, so subtrees which
+    // are not equivalent never become equivalent. Thus, for each structure, the nodes of any resulting DRAG
+    // are at least as many as a set of mutually non-equivalent subtrees, which is built greedily.
+    static size_t NodesLowerBound(std::vector<CollectDragStatistics::STreeProp>& trees)
+    {
+        CollectDragStatistics::VisitedPairs visited;
+        std::unordered_map<uint64_t, std::vector<size_t>> structures;
+        for (size_t i = 0; i < trees.size(); ++i) {
+            if (!trees[i].leaf()) {
+                structures[trees[i].structure_].push_back(i);
             }
+        }
 
-            if (a->isleaf()) {
-                a->data.action &= b->data.action;
-            }
-            else {
-                MergeEquivalentTreesAndUpdateRec(a->left, b->left);
-                MergeEquivalentTreesAndUpdateRec(a->right, b->right);
+        size_t bound = 0;
+        for (const auto& [conditions, nodes] : structures) {
+            std::vector<size_t> distinct;
+            for (size_t i : nodes) {
+                if (std::none_of(begin(distinct), end(distinct), [&](size_t j) { return trees[i].equivalent(trees[j], visited); })) {
+                    distinct.push_back(i);
+                }
             }
+            bound += distinct.size();
         }
+        return bound;
+    }
+
+    enum class Expansion {
+        LEAF,   // The DRAG has no equivalent subtrees
+        PRUNED, // No DRAG reachable from this one has less than the given number of nodes
+        MERGES  // Merges have been performed
     };
 
-    BinaryDrag<conact> best_bd_;
+    // Pairs of equivalent subtrees of a DRAG which can be merged, in the order in which the serial search explores them
+    struct Merges {
+        Expansion expansion;
+        std::vector<std::pair<BinaryDrag<conact>::node*, BinaryDrag<conact>::node*>> pairs;
+    };
 
-    void FastDragOptimizerRec(BinaryDrag<conact>& bd, DragCompressorFlags flags)
+    // Finds the merges of equivalent subtrees which can be performed on bd. None is returned if none of the DRAGs
+    // which can be obtained from bd has less than bound nodes (see NodesLowerBound).
+    static Merges FindMerges(SearchDrag& s, bool ignore_leaves, size_t bound)
     {
-        if (early_stopping_reached_ && early_stopping_active_) {
-            return;
+        // Push the statistics of subtrees into a vector so that they are easier to use.
+        // Subtrees are pushed in visit order (not in the order of np_, which depends on
+        // the addresses of nodes), so that the search order only depends on the DRAG
+        // structure
+        std::vector<CollectDragStatistics::STreeProp> trees;
+        auto& cds = s.cds;
+        std::unordered_set<BinaryDrag<conact>::node*> visited;
+        std::function<void(BinaryDrag<conact>::node*)> CollectRec = [&](BinaryDrag<conact>::node* n) {
+            if (visited.insert(n).second) {
+                trees.push_back(cds.np_.at(n));
+                if (!n->isleaf()) {
+                    CollectRec(n->left);
+                    CollectRec(n->right);
+                }
+            }
+        };
+        for (const auto& t : s.bd.roots_) {
+            CollectRec(t);
         }
 
-        bool print_status_bar = flags & DragCompressorFlags::PRINT_STATUS_BAR;
-        bool ignore_leaves = flags & DragCompressorFlags::IGNORE_LEAVES;
-        bool save_intermediate_results = flags & DragCompressorFlags::SAVE_INTERMEDIATE_RESULTS;
-
-        // Collect information of trees'/drags' subtrees (as strings) and push
-        // them into a vector so that they are easier to use
-        std::vector<CollectDragStatistics::STreeProp> trees;
-        CollectDragStatistics cds(bd);
-        for (const auto& x : cds.np_) {
-            trees.push_back(x.second);
+        if (bound != std::numeric_limits<size_t>::max() && NodesLowerBound(trees) >= bound) {
+            return { Expansion::PRUNED, {} };
         }
 
+        CollectDragStatistics::VisitedPairs pairs;
+
         // For each subtree (with or without considering leaves) ...
         for (size_t i = 0; i < trees.size(); ) {
-            if (ignore_leaves && trees[i].conditions_ == ".") {
+            if (ignore_leaves && trees[i].leaf()) {
                 trees.erase(begin(trees) + i);
                 continue;
             }
             bool eq = false;
             // ... check all the other subtrees to find equivalences
             for (size_t j = 0; j < trees.size(); ++j) {
-                if (i != j && trees[i].equivalent(trees[j])) {
+                if (i != j && trees[i].equivalent(trees[j], pairs)) {
                     eq = true;
                     break;
                 }
@@ -404,54 +541,163 @@ private:
         // tested. Ordering the tree is useful to find, in some cases, the best or
         // pseudo optimal solution earlier, so that when the process does not end 
         // in "good time" we still have a good solution/compression.
-        sort(begin(trees), end(trees), [](const CollectDragStatistics::STreeProp& a, const CollectDragStatistics::STreeProp& b) {
-            return a.conditions_.size() > b.conditions_.size();
+        stable_sort(begin(trees), end(trees), [](const CollectDragStatistics::STreeProp& a, const CollectDragStatistics::STreeProp& b) {
+            return a.size_ > b.size_;
         });
 
         // Compare each subtree which has equivalent subtrees with all the others
-        bool no_eq = true;
+        Merges m{ Expansion::LEAF, {} };
         for (size_t i = 0; i < trees.size(); ++i) {
-            bool eq = false;
-            size_t j;
-            for (j = i + 1; j < trees.size(); ++j) {
-                if (trees[i].equivalent(trees[j])) {
+            for (size_t j = i + 1; j < trees.size(); ++j) {
+                if (trees[i].equivalent(trees[j], pairs)) {
                     // Here an equivalence is found!
-                    no_eq = false;
-
-                    // Then we need to copy the original (entire) tree 
-                    // keeping track of some nodes. Indeed, to perform
-                    // the link update, we need to know the pointers to
-                    // the roots of the equivalent subtrees after the 
-                    // copy.
-                    std::vector<BinaryDrag<conact>::node*> tracked_nodes{ trees[i].n_, trees[j].n_ };
-                    BinaryDrag<conact> bd_copy(bd, tracked_nodes);
-
-                    // Re-calculate subtrees/node statistics over the tree 
-                    // copy since pointers to nodes are changed.
-                    CollectDragStatistics cds(bd_copy);
-
-                    // Perform the merge of equivalent trees updating links
-                    MergeEquivalentTreesAndUpdate(tracked_nodes[0], tracked_nodes[1], cds.parents_);
-                    
-                    // Remove equal subtrees inside a BinaryDrag. Is this really
-                    // necessary here? Maybe it isn't but performing this operation
-                    // here can improve the efficiency of the compression in case 
-                    // there are actually equal sub-trees.
-                    RemoveEqualSubtrees{ bd_copy };
-
-                    // Recursively call the compression function on the current
-                    // resulting tree
-                    FastDragOptimizerRec(bd_copy, flags);
+                    m.pairs.emplace_back(trees[i].n_, trees[j].n_);
                 }
             }
         }
+        if (!m.pairs.empty()) {
+            m.expansion = Expansion::MERGES;
+        }
+        return m;
+    }
+
+    // Returns the DRAG obtained from s merging the equivalent subtrees rooted in a and b (nodes of s), with its
+    // statistics. These are copied from those of s and updated by the merge, which also merges the subtrees which
+    // become equal (as RemoveEqualSubtrees), unless s has equal subtrees itself.
+    static SearchDrag Merge(const SearchDrag& s, BinaryDrag<conact>::node* a, BinaryDrag<conact>::node* b)
+    {
+        // The pointers to the nodes of the copy are required to perform the link
+        // update and to copy the statistics
+        std::unordered_map<BinaryDrag<conact>::node*, BinaryDrag<conact>::node*> copies;
+        BinaryDrag<conact> bd_copy(s.bd, copies);
+
+        if (s.cds.minimal_) {
+            CollectDragStatistics cds(s.cds, copies);
+            cds.Merge(bd_copy, copies.at(a), copies.at(b));
+            return { std::move(bd_copy), std::move(cds) };
+        }
+
+        // Only the DRAG at the beginning of a round may have equal subtrees: they are removed, and the statistics
+        // of the result are collected from scratch
+        CollectDragStatistics cds(bd_copy);
+        cds.Merge(bd_copy, copies.at(a), copies.at(b));
+        RemoveEqualSubtrees{ bd_copy };
+        return SearchDrag(std::move(bd_copy));
+    }
+
+    // Calls f on every DRAG obtained from s merging a pair of its equivalent subtrees, in the order in which
+    // the serial search explores them, skipping the first ones (already explored by a resumed search). Nothing
+    // is done if none of the DRAGs which can be obtained from s has less than bound nodes (see NodesLowerBound).
+    template <typename F>
+    static Expansion ForEachMerge(SearchDrag& s, bool ignore_leaves, size_t bound, uint32_t first, F f)
+    {
+        Merges m = FindMerges(s, ignore_leaves, bound);
+        for (size_t k = first; k < m.pairs.size(); ++k) {
+            SearchDrag child = Merge(s, m.pairs[k].first, m.pairs[k].second);
+            f(child);
+        }
+        return m.expansion;
+    }
+
+    // Updates the best DRAG with the given leaf of the search, if it has less nodes
+    void UpdateBest(BinaryDrag<conact>& bd, DragCompressorFlags flags)
+    {
+        bool print_status_bar = flags & DragCompressorFlags::PRINT_STATUS_BAR;
+        bool save_intermediate_results = flags & DragCompressorFlags::SAVE_INTERMEDIATE_RESULTS;
+
+        BinaryDragStatistics bds(bd);
+        if (bds.Nodes() < best_nodes_) {
+            // New better binary drag found ...
+            changes_ = true;
+            iterations_left_ = iterations_max_;
+
+            // ... compress the leaves of the current optimal binary drag
+            MergeSpecialLeaves{ bd };
+            MergeLeaves{ bd };
+
+            // ... and finally update class attributes accordingly
+            BinaryDragStatistics bds(bd);
+            best_nodes_  = bds.Nodes();
+            best_leaves_ = bds.Leaves();
+            best_bd_ = bd;
+
+            // ... save the current tree if needed
+            if (save_intermediate_results) {
+                DrawDagOnFile("BestDrag" + zerostr(progress_counter_, 10), bd);
+            }
+
+            // ... print status if needed
+            if (print_status_bar) {
+                os_ << "\r" << progress_counter_ << " - nodes: " << bds.Nodes() << "; leaves: " << bds.Leaves() << "\n";
+            }
+        }
+    }
 
-        if (no_eq) {
+    // Explores all the possible sequences of merges of equivalent subtrees, depth-first
+    void FastDragOptimizerRec(SearchDrag& s, DragCompressorFlags flags)
+    {
+        if (early_stopping_reached_ && early_stopping_active_) {
+            return;
+        }
+
+        if (interrupted_) {
+            return;
+        }
+        if (TimeOut()) {
+            stop_path_ = path_;
+            return;
+        }
+
+        // A resumed search reaches the node where the previous one stopped descending the merges along its path
+        uint32_t first = 0;
+        if (!resume_path_.empty()) {
+            if (path_.size() < resume_path_.size()) {
+                first = resume_path_[path_.size()];
+            }
+            else {
+                resume_path_.clear();
+            }
+        }
+        else if (!checkpoint_.empty() && std::chrono::steady_clock::now() >= next_checkpoint_) {
+            SaveCheckpoint(path_, false);
+        }
+
+        // Different sequences of merges often reach the same DRAG, which is explored only once: the
+        // leaves of the search reached later are the same already found, and can't be selected. Early
+        // stopping counts every leaf reached, so skipping DRAGs would change the selected one: the table
+        // is then not used
+        if (!early_stopping_active_ && explored_.Visited(TranspositionTable::DragKey(s.bd))) {
+            return;
+        }
+
+        bool print_status_bar = flags & DragCompressorFlags::PRINT_STATUS_BAR;
+        bool ignore_leaves = flags & DragCompressorFlags::IGNORE_LEAVES;
+
+        // A leaf of the search replaces the best DRAG only if it has less nodes: the search stops
+        // when the DRAGs which can be reached from the current one are not better than the best.
+        // As for the table, pruned leaves would not be counted by early stopping, which thus disables pruning
+        bool pruning = conf.drag_compressor_pruning_ && !early_stopping_active_;
+        size_t bound = pruning ? best_nodes_ : std::numeric_limits<size_t>::max();
+        uint32_t k = first;
+        Expansion e = ForEachMerge(s, ignore_leaves, bound, first, [&](SearchDrag& child) {
+            // Recursively call the compression function on the current
+            // resulting tree
+            path_.push_back(k++);
+            FastDragOptimizerRec(child, flags);
+            path_.pop_back();
+            // The nodes after the first one are not on the path of a resumed search
+            resume_path_.clear();
+        });
+
+        if (e == Expansion::PRUNED) {
+            ++pruned_;
+        }
+        else if (e == Expansion::LEAF) {
             // Display a raw progress status if needed
             ++progress_counter_;
             if (print_status_bar) {
                 if (progress_counter_ % 1000 == 0) {
-                    std::cout << "\r" << progress_counter_ << std::flush;
+                    os_ << "\r" << progress_counter_ << SearchStatus() << std::flush;
                 }
             }
 
@@ -459,34 +705,37 @@ private:
                 early_stopping_reached_ = true;
             }
 
-            BinaryDragStatistics bds(bd);
-            if (bds.Nodes() < best_nodes_) {
-                // New better binary drag found ...
-                changes_ = true;
-                iterations_left_ = iterations_max_;
-
-                // ... compress the leaves of the current optimal binary drag
-                MergeSpecialLeaves{ bd };
-                MergeLeaves{ bd };
-
-                // ... and finally update class attributes accordingly
-                BinaryDragStatistics bds(bd);
-                best_nodes_  = bds.Nodes();
-                best_leaves_ = bds.Leaves();
-                best_bd_ = bd;
-
-                // ... save the current tree if needed
-                if (save_intermediate_results) {
-                    DrawDagOnFile("BestDrag" + zerostr(progress_counter_, 10), bd);
-                }
-
-                // ... print status if needed
-                if (print_status_bar) {
-                    std::cout << "\r" << progress_counter_ << " - nodes: " << bds.Nodes() << "; leaves: " << bds.Leaves() << "\n";
-                }
+            UpdateBest(s.bd, flags);
+        }
+    }
 
+    // Same search of FastDragOptimizerRec, performed by SearchThreads() threads (see drag_compressor.cpp)
+    void ParallelDragOptimizer(BinaryDrag<conact>& bd, DragCompressorFlags flags);
+
+    // Heuristic searches, which visit a small part of the sequences of merges (see drag_compressor.cpp)
+    void BeamSearch(BinaryDrag<conact>& bd, DragCompressorFlags flags);
+    void SimulatedAnnealing(BinaryDrag<conact>& bd, DragCompressorFlags flags);
+    // Counts a leaf of a heuristic search, which replaces the best DRAG if it has less nodes
+    void HeuristicLeaf(const BinaryDrag<conact>& bd, size_t nodes, DragCompressorFlags flags);
+
+    void DragOptimizer(BinaryDrag<conact>& bd, DragCompressorFlags flags) {
+        bool beam_search = flags & DragCompressorFlags::BEAM_SEARCH;
+        bool simulated_annealing = flags & DragCompressorFlags::SIMULATED_ANNEALING;
+        if (beam_search || simulated_annealing) {
+            if (beam_search) {
+                BeamSearch(bd, flags);
+            }
+            if (simulated_annealing) {
+                SimulatedAnnealing(bd, flags);
             }
         }
+        else if (SearchThreads() > 1) {
+            ParallelDragOptimizer(bd, flags);
+        }
+        else {
+            SearchDrag s(bd);
+            FastDragOptimizerRec(s, flags);
+        }
     }
 };
 
@@ -7,37 +7,57 @@
 #ifndef GRAPHGEN_FIND_OPTIMAL_DRAG_H_
 #define GRAPHGEN_FIND_OPTIMAL_DRAG_H_
 
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <unordered_set>
 #include <mutex>
 #include <thread>
+#include <tuple>
 
-#include "pool.h"
-
+#include "arena_drag.h"
 #include "conact_tree.h"
 #include "remove_equal_subtrees.h"
 
+// Finds the DRAG with the minimum number of nodes (and then of leaves) among all the trees obtained choosing
+// a single action for each leaf with multiple actions, once equal subtrees are merged.
+//
+// The assignments of actions are enumerated as mixed-radix numbers, the first leaf being the most significant
+// digit. Threads take disjoint prefixes of the assignment (the actions of the first leaves) and enumerate the
+// remaining leaves on their own copy of the tree, keeping a local best which is merged at the end: among
+// the trees with the same number of nodes and leaves the first one in enumeration order is selected, so the
+// result doesn't depend on the number of threads.
 struct FindOptimalDrag {
     std::vector<BinaryDrag<conact>::node*> lma_; // leaves with multiple actions
     std::unordered_set<BinaryDrag<conact>::node*> visited_; // utility set to remember already visited nodes
     BinaryDrag<conact> t_;
 
     BinaryDrag<conact> best_tree_;
-    uint counter_ = 0;
     uint best_nodes_ = std::numeric_limits<uint>::max();
     uint best_leaves_ = std::numeric_limits<uint>::max();
 
-    std::mutex best_tree_mutex_;
-    thread_pool *pool_ = nullptr;
+    size_t nthreads_;
+    double total_ = 1;                    // Number of trees to be enumerated (as a double, since it easily overflows)
+    std::atomic<uint64_t> counter_ = 0;   // Number of trees enumerated so far
+    double seconds_ = 0;                  // Duration of the last enumeration
 
-    FindOptimalDrag(BinaryDrag<conact> t) : t_{ std::move(t) } {
+    // Number of threads (0 means one thread for each hardware core)
+    FindOptimalDrag(BinaryDrag<conact> t, size_t nthreads = 0) : t_{ std::move(t) }, nthreads_{ nthreads } {
         GetLeavesWithMultipleActionsRec(t_.GetRoot());
+        for (const auto& l : lma_) {
+            total_ *= l->data.actions().size();
+        }
+        if (nthreads_ == 0) {
+            nthreads_ = std::max(std::thread::hardware_concurrency(), 1u);
+        }
     }
 
     // This method fill the lma_ variable with all the leaves that have multiple actions. This
-    // vector (lma_) will be used by the backtrack algorithm to generate all the possible trees 
+    // vector (lma_) will be used by the backtrack algorithm to generate all the possible trees
     // (i.e all the possible trees with one action per leaf).
     void GetLeavesWithMultipleActionsRec(BinaryDrag<conact>::node* n) {
         if (visited_.count(n) > 0) {
@@ -54,56 +74,171 @@ struct FindOptimalDrag {
         GetLeavesWithMultipleActionsRec(n->right);
     }
 
-    void ReduceAndUpdateBest(BinaryDrag<conact> t)
+    // Fraction of the trees enumerated so far, between 0 and 1
+    double Progress() const { return counter_ / total_; }
+
+    // Trees enumerated per second by the last (or current) enumeration
+    double Throughput() const { return seconds_ > 0 ? counter_ / seconds_ : 0; }
+
+    void GenerateAllTrees()
     {
-        //RemoveEqualSubtrees sc(t.GetRoot()); TODO originale
-        RemoveEqualSubtrees sc(t);
+        // Prefixes are many more than threads and are taken one at a time, so that the work stays
+        // balanced even if threads run at different speeds
+        size_t prefix_len = 0;
+        uint64_t prefixes = 1;
+        while (prefix_len < lma_.size() && prefixes < 64 * nthreads_) {
+            prefixes *= lma_[prefix_len++]->data.actions().size();
+        }
 
-        std::lock_guard<std::mutex> lock(best_tree_mutex_);
-        if (best_nodes_ > sc.nodes_ || (best_nodes_ == sc.nodes_ && best_leaves_ > sc.leaves_)) {
-            best_nodes_ = sc.nodes_;
-            best_leaves_ = sc.leaves_;
-            best_tree_ = std::move(t);
-            std::cout << "\rbest_nodes_ = " << best_nodes_ << " - best_leaves_ = " << best_leaves_ << "\n";
+        std::vector<std::vector<uint>> actions;
+        for (const auto& l : lma_) {
+            actions.push_back(l->data.actions());
         }
 
-        if (counter_ == 0) {
-            std::cout << "  0%";
+        std::vector<Best> bests(nthreads_);
+        std::atomic<uint64_t> next_prefix = 0;
+        std::atomic<size_t> running = nthreads_;
+        std::mutex m;
+        std::condition_variable done;
+        counter_ = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        auto worker = [&](size_t id) {
+            // Each thread works on its own copy of the tree
+            std::vector<BinaryDrag<conact>::node*> lma = lma_;
+            BinaryDrag<conact> t(t_, lma);
+            Enumeration e{ t, lma, actions, bests[id], counter_ };
+            for (uint64_t p; (p = next_prefix++) < prefixes; ) {
+                // Decode the prefix index into the actions of the first leaves
+                std::vector<uint> digits(prefix_len);
+                uint64_t index = p;
+                for (size_t i = prefix_len; i-- > 0; ) {
+                    digits[i] = static_cast<uint>(index % actions[i].size());
+                    index /= actions[i].size();
+                }
+                e.index_ = p;
+                e.position_ = 0;
+                for (size_t i = 0; i < prefix_len; ++i) {
+                    e.Set(i, digits[i]);
+                }
+                e.Rec(prefix_len);
+                e.Flush();
+            }
+            if (--running == 0) {
+                std::lock_guard<std::mutex> lock(m);
+                done.notify_one();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < nthreads_; ++i) {
+            threads.emplace_back(worker, i);
+        }
+        {
+            std::unique_lock<std::mutex> lock(m);
+            while (!done.wait_for(lock, std::chrono::seconds(1), [&] { return running == 0; })) {
+                seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "\r" << std::fixed << std::setprecision(1) << std::setw(5) << 100 * Progress() << "% - "
+                          << std::setprecision(0) << Throughput() << " trees/s" << std::defaultfloat << std::flush;
+            }
         }
+        for (auto& t : threads) {
+            t.join();
+        }
+        seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-        if (++counter_ % 79626 == 0) {
-            std::cout << "\r" << std::setfill(' ') << std::setw(3) << counter_ / 79626 << "%";
+        // Merge the local bests
+        const Best* best = nullptr;
+        for (const auto& b : bests) {
+            if (b.found_ && (best == nullptr || b < *best)) {
+                best = &b;
+            }
         }
+        if (best != nullptr) {
+            best_nodes_ = best->nodes_;
+            best_leaves_ = best->leaves_;
+            best_tree_ = best->tree_;
+            RemoveEqualSubtrees{ best_tree_ };
+        }
+        std::cout << "\r" << counter_ << " trees in " << std::fixed << std::setprecision(1) << seconds_ << " s ("
+                  << std::setprecision(0) << Throughput() << " trees/s) - best_nodes_ = " << best_nodes_
+                  << " - best_leaves_ = " << best_leaves_ << std::defaultfloat << "\n";
     }
 
-    void GenerateAllTreesRec(int cur_leaf)
-    {
-        if (cur_leaf == lma_.size()) {
-            // We have a tree without multiple actions
-
-            pool_->enqueue_work(&FindOptimalDrag::ReduceAndUpdateBest, this, t_);
-
-            return;
+private:
+    struct Best {
+        bool found_ = false;
+        uint nodes_ = std::numeric_limits<uint>::max();
+        uint leaves_ = std::numeric_limits<uint>::max();
+        uint64_t prefix_ = 0;   // Prefix from which the tree has been found, and position among the trees of the prefix
+        uint64_t position_ = 0;
+        BinaryDrag<conact> tree_;
+
+        bool operator<(const Best& rhs) const {
+            return std::tie(nodes_, leaves_, prefix_, position_) < std::tie(rhs.nodes_, rhs.leaves_, rhs.prefix_, rhs.position_);
+        }
+    };
+
+    // Enumeration of the trees with a given prefix, performed by a single thread on its copy of the tree
+    struct Enumeration {
+        BinaryDrag<conact>& t_;
+        std::vector<BinaryDrag<conact>::node*>& lma_;
+        const std::vector<std::vector<uint>>& actions_;
+        Best& best_;
+        std::atomic<uint64_t>& counter_;
+        uint64_t index_ = 0;    // Current prefix
+        uint64_t position_ = 0; // Trees enumerated from the current prefix
+        uint64_t pending_ = 0;  // Trees not yet added to the shared counter
+
+        void Set(size_t leaf, uint digit) {
+            std::bitset<131/*CTBE needs 131 bits*/> bs;
+            bs.set(actions_[leaf][digit] - 1);
+            lma_[leaf]->data.action = bs;
         }
 
-        auto action_bs = lma_[cur_leaf]->data.action;
-        auto actions = lma_[cur_leaf]->data.actions(); // vector of actions ("uint")
+        void Rec(size_t cur_leaf) {
+            if (cur_leaf == lma_.size()) {
+                // We have a tree without multiple actions
+                Evaluate();
+                return;
+            }
+            for (uint i = 0; i < actions_[cur_leaf].size(); ++i) {
+                Set(cur_leaf, i);
+                Rec(cur_leaf + 1);
+            }
+        }
 
-        for (size_t i = 0; i < actions.size(); ++i) {
-            std::bitset<131/*CTBE needs 131 bits*/> bs;
-            bs.set(actions[i] - 1);
-            lma_[cur_leaf]->data.action = bs;
-            GenerateAllTreesRec(cur_leaf + 1);
+        void Evaluate() {
+            // Equal subtrees are merged in the hash-consed version of the tree, without modifying it
+            ArenaDrag reduced(t_);
+            uint nodes = 0, leaves = 0;
+            for (ArenaDrag::id i = 0; i < reduced.size(); ++i) {
+                if (reduced.node(i).isleaf()) {
+                    ++leaves;
+                }
+                else {
+                    ++nodes;
+                }
+            }
+            if (best_.nodes_ > nodes || (best_.nodes_ == nodes && best_.leaves_ > leaves)) {
+                best_.found_ = true;
+                best_.nodes_ = nodes;
+                best_.leaves_ = leaves;
+                best_.prefix_ = index_;
+                best_.position_ = position_;
+                best_.tree_ = t_;
+            }
+            ++position_;
+            if (++pending_ == 1024) {
+                Flush();
+            }
         }
-        lma_[cur_leaf]->data.action = action_bs;
-    }
 
-    void GenerateAllTrees()
-    {
-        pool_ = new thread_pool(8, 8);
-        GenerateAllTreesRec(0);
-        delete pool_;
-    }
+        void Flush() {
+            counter_ += pending_;
+            pending_ = 0;
+        }
+    };
 };
 
-#endif // GRAPHGEN_FIND_OPTIMAL_DRAG_H_
\ No newline at end of file
+#endif // GRAPHGEN_FIND_OPTIMAL_DRAG_H_
@@ -6,18 +6,23 @@
 
 #include "forest.h"
 
+#include <atomic>
+#include <future>
 #include <optional>
+#include <thread>
 
 #include <cassert>
 
 #include "drag_compressor.h"
 #include "forest_optimizer.h"
+#include "pool.h"
 
 using namespace std;
 
 LineForestHandler::LineForestHandler(const BinaryDrag<conact>& bd,
     const pixel_set& ps,
-    const constraints& initial_constraints) {
+    const constraints& initial_constraints,
+    size_t nthreads) {
     // The input BinaryDrag should have just one root!
     if (bd.roots_.size() > 1) {
         throw;
@@ -57,7 +62,7 @@ LineForestHandler::LineForestHandler(const BinaryDrag<conact>& bd,
      ********************/
 
      // Create all the possible reduced trees storing them into f_
-    CreateReducedDrag(tmp, f_, ps);
+    CreateReducedDrag(tmp, f_, ps, nthreads);
 
     // Remove duplicate trees and then useless conditions until convergence
     while (RemoveEqualTrees()) {
@@ -345,6 +350,103 @@ void LineForestHandler::InitNextRec(BinaryDrag<conact>::node* n) {
     }
 }
 
+ReducibleTree::ReducibleTree(const BinaryDrag<conact>::node* root) {
+    function<uint32_t(const BinaryDrag<conact>::node*)> FlattenRec = [&](const BinaryDrag<conact>::node* n) {
+        uint32_t id = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back({ kLeaf, 0, 0, n });
+        if (!n->isleaf()) {
+            auto c = conditions_.emplace(n->data.condition, static_cast<uint32_t>(conditions_.size())).first->second;
+            uint32_t left = FlattenRec(n->left);
+            uint32_t right = FlattenRec(n->right);
+            nodes_[id] = { c, left, right, n };
+        }
+        return id;
+    };
+    FlattenRec(root);
+}
+
+BinaryDrag<conact>::node* ReducibleTree::Reduce(const ConstraintMask& constr, BinaryDrag<conact>& t, uint32_t n) const {
+    const Node& cur = nodes_[n];
+    if (cur.condition == kLeaf) {
+        return t.make_node(cur.n->data);
+    }
+    else {
+        if (constr.Known(cur.condition)) {
+            if (constr.Value(cur.condition) == 0)
+                return Reduce(constr, t, cur.left);
+            else
+                return Reduce(constr, t, cur.right);
+        }
+        else {
+            return t.make_node(cur.n->data, Reduce(constr, t, cur.left), Reduce(constr, t, cur.right));
+        }
+    }
+}
+
+LineForestHandler::CreateReducedDrag::CreateReducedDrag(const BinaryDrag<conact>& bd, BinaryDrag<conact>& f, const pixel_set& ps, size_t nthreads) : bd_{ bd }, f_{ f }, eq_{ ps }, rt_{ bd.roots_[0] } {
+    eq_index_.resize(rt_.Conditions(), rt_.Conditions());
+    for (const auto& [condition, i] : rt_.conditions_) {
+        auto ft = eq_.Find(condition);
+        if (ft) {
+            eq_index_[i] = rt_.Index(ft);
+        }
+    }
+    CollectLeavesRec(0, ConstraintMask(rt_.Conditions()));
+
+    if (nthreads == 0) {
+        nthreads = max(thread::hardware_concurrency(), 1u);
+    }
+
+    // Consecutive leaves are reduced into the same BinaryDrag. Chunks are more than threads to balance the work
+    size_t nchunks = min(leaves_.size(), nthreads > 1 ? nthreads * 8 : 1);
+    vector<BinaryDrag<conact>> chunks(nchunks);
+    auto ReduceChunk = [&](size_t c) {
+        for (size_t i = c * leaves_.size() / nchunks; i < (c + 1) * leaves_.size() / nchunks; ++i) {
+            chunks[c].AddRoot(rt_.Reduce(leaves_[i], chunks[c]));
+        }
+    };
+    if (nthreads <= 1 || nchunks <= 1) {
+        for (size_t c = 0; c < nchunks; ++c) {
+            ReduceChunk(c);
+        }
+    }
+    else {
+        thread_pool pool(static_cast<unsigned>(nchunks), min(nthreads, nchunks));
+        vector<future<void>> reduced;
+        for (size_t c = 0; c < nchunks; ++c) {
+            reduced.push_back(pool.enqueue_task(ReduceChunk, c));
+        }
+        for (auto& r : reduced) {
+            r.get();
+        }
+    }
+
+    // Nodes are moved, so their addresses don't change
+    for (auto& chunk : chunks) {
+        move(begin(chunk.nodes_), end(chunk.nodes_), back_inserter(f_.nodes_));
+        f_.roots_.insert(end(f_.roots_), begin(chunk.roots_), end(chunk.roots_));
+    }
+}
+
+// The constraints of each branch are those of the parent, plus the value of the condition equivalent to the one
+// of the node, if any
+void LineForestHandler::CreateReducedDrag::CollectLeavesRec(uint32_t n, const ConstraintMask& constr) {
+    const auto& cur = rt_.nodes_[n];
+    if (cur.condition == ReducibleTree::kLeaf) {
+        leaves_.push_back(constr);
+    }
+    else {
+        ConstraintMask constrNew = constr;
+        size_t ft = eq_index_[cur.condition];
+        if (ft < rt_.Conditions())
+            constrNew.Set(ft, 0);
+        CollectLeavesRec(cur.left, constrNew);
+        if (ft < rt_.Conditions())
+            constrNew.Set(ft, 1);
+        CollectLeavesRec(cur.right, constrNew);
+    }
+}
+
 // Perform tree pruning by removing useless nodes. Useless nodes are identified looking at given constraints 
 BinaryDrag<conact>::node* LineForestHandler::Reduce(const BinaryDrag<conact>::node* n, BinaryDrag<conact>& t, const constraints& constr) {
     if (n->isleaf()) {
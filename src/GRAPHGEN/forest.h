@@ -8,8 +8,11 @@
 #define GRAPHGEN_FOREST_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <map>
 #include <numeric>
+#include <unordered_map>
+#include <vector>
 
 #include "conact_tree.h"
 #include "pixel_set.h"
@@ -46,6 +49,59 @@ struct Equivalences {
 using constraints = std::map<std::string, int>;
 static std::vector<size_t> DEFAULT_VECTOR; // Dummy vector for the default value of DeleteTree member function
 
+/** @brief Constraints stored as dense bit masks over condition indices (see ReducibleTree).
+
+Bit i of known_ tells whether the condition with index i is constrained, and bit i of value_ is its value.
+*/
+struct ConstraintMask {
+    std::vector<uint64_t> known_, value_;
+
+    ConstraintMask(size_t conditions = 0) : known_((conditions + 63) / 64), value_((conditions + 63) / 64) {}
+
+    void Set(size_t i, int value) {
+        known_[i / 64] |= uint64_t(1) << (i % 64);
+        if (value) {
+            value_[i / 64] |= uint64_t(1) << (i % 64);
+        }
+        else {
+            value_[i / 64] &= ~(uint64_t(1) << (i % 64));
+        }
+    }
+    bool Known(size_t i) const { return (known_[i / 64] >> (i % 64)) & 1; }
+    int Value(size_t i) const { return (value_[i / 64] >> (i % 64)) & 1; }
+};
+
+/** @brief Flattened copy of a tree, in which conditions are replaced by their indices.
+
+Reducing the tree under a ConstraintMask then requires no lookup by condition name. Nodes are stored in
+visit order, the root being the first one, and conditions are indexed in order of first appearance.
+*/
+struct ReducibleTree {
+    static constexpr uint32_t kLeaf = UINT32_MAX;
+    struct Node {
+        uint32_t condition;     // Index of the condition, kLeaf for leaves
+        uint32_t left, right;
+        const BinaryDrag<conact>::node* n;
+    };
+
+    std::vector<Node> nodes_;
+    std::unordered_map<std::string, uint32_t> conditions_;
+
+    ReducibleTree(const BinaryDrag<conact>::node* root);
+
+    /** @brief Returns the number of distinct conditions */
+    size_t Conditions() const { return conditions_.size(); }
+
+    /** @brief Returns the index of a condition, or Conditions() if it doesn't appear in the tree */
+    size_t Index(const std::string& condition) const {
+        auto it = conditions_.find(condition);
+        return it != conditions_.end() ? it->second : Conditions();
+    }
+
+    /** @brief Same of LineForestHandler::Reduce, for the subtree rooted in node n */
+    BinaryDrag<conact>::node* Reduce(const ConstraintMask& constr, BinaryDrag<conact>& t, uint32_t n = 0) const;
+};
+
 /** @brief Generates all the forests needed to handle one line of the image.
 */
 struct LineForestHandler {
@@ -57,35 +113,24 @@ struct LineForestHandler {
     When a leaf is reached the original tree is reduced using current branch's constraints. All the attributes are
     temporary objects, so this class can be used as function.
 
+    Constraints of the leaves are collected first, as bit masks. Then the reductions, which are independent, are
+    performed by nthreads threads (0 means one for each hardware core), each one on consecutive leaves and into its
+    own BinaryDrag. These are finally moved into f_ in leaf order, so that f_ is the same whatever the number of
+    threads. Callers which already run in a pool should pass 1, so that the reductions are performed serially.
     */
     struct CreateReducedDrag {
         const BinaryDrag<conact>& bd_;
         BinaryDrag<conact>& f_;
         Equivalences eq_;
+        ReducibleTree rt_;
+        std::vector<size_t> eq_index_;          // Index of the condition equivalent to each condition (Conditions() if none)
+        std::vector<ConstraintMask> leaves_;    // Constraints of each leaf, in visit order
 
         // bd is the original binary drag from which to generate the forest and f is where to write the trees
-        CreateReducedDrag(const BinaryDrag<conact>& bd, BinaryDrag<conact>& f, const pixel_set& ps) : bd_{ bd }, f_{ f }, eq_{ps} {
-            constraints constr;
-            CreateReducedTreesRec(bd_.roots_[0], constr);
-        }
+        CreateReducedDrag(const BinaryDrag<conact>& bd, BinaryDrag<conact>& f, const pixel_set& ps, size_t nthreads);
 
-        // See CreateReducedTrees 
-        void CreateReducedTreesRec(const BinaryDrag<conact>::node* n, const constraints& constr) {
-            if (n->isleaf()) {
-                // Create a reduced version of the tree based on what we learned on the path to this leaf. The new tree is stored in t_ as well.
-                f_.AddRoot(Reduce(bd_.roots_[0], f_, constr));
-            }
-            else {
-                constraints constrNew = constr;
-                auto ft = eq_.Find(n->data.condition);
-                if (ft)
-                    constrNew[ft] = 0;
-                CreateReducedTreesRec(n->left, constrNew);
-                if (ft)
-                    constrNew[ft] = 1;
-                CreateReducedTreesRec(n->right, constrNew);
-            }
-        }
+        // Collects the constraints of the leaves of the subtree rooted in node n of rt_
+        void CollectLeavesRec(uint32_t n, const ConstraintMask& constr);
     };
 
     
@@ -98,7 +143,9 @@ struct LineForestHandler {
     std::vector<std::vector<size_t>> main_end_tree_mapping_; // This is the mapping between main trees and end trees
 
     LineForestHandler() {}
-    LineForestHandler(const BinaryDrag<conact>& t, const pixel_set& ps, const constraints& initial_constraints = {}); // Initial_constraints are useful to create particular forests such as the first line forest
+    // Initial_constraints are useful to create particular forests such as the first line forest. nthreads is the number
+    // of threads which create the reduced trees of the main forest (see CreateReducedDrag)
+    LineForestHandler(const BinaryDrag<conact>& t, const pixel_set& ps, const constraints& initial_constraints = {}, size_t nthreads = conf.drag_compressor_forest_threads_);
 
     void RemoveUselessConditions();
     void RemoveEndTreesUselessConditions();
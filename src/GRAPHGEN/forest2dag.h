@@ -7,22 +7,26 @@
 #ifndef GRAPHGEN_FOREST2DAG_H_
 #define GRAPHGEN_FOREST2DAG_H_
 
-#include <iterator>
-#include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "arena_drag.h"
 #include "forest.h"
 
 // Converts forest of decision trees into poly-rooted-dag
 struct Forest2Dag {
-	std::unordered_map<BinaryDrag<conact>::node*, std::string> ps_; // pointer -> string
-	std::unordered_map<std::string, BinaryDrag<conact>::node*> sp_; // string -> pointer
+	ArenaDrag ids_; // structural ids of the subtrees
+	std::unordered_map<BinaryDrag<conact>::node*, ArenaDrag::id> pi_; // pointer -> id
+	std::vector<BinaryDrag<conact>::node*> ip_; // id -> pointer (nullptr if not linked yet)
 	LineForestHandler& f_;
 
-	std::string Tree2String(BinaryDrag<conact>::node* n);
+	ArenaDrag::id TreeId(BinaryDrag<conact>::node* n);
 
 	void FindAndLink(BinaryDrag<conact>::node* n);
 
+	// Removes the memoized ids, so that following calls to FindAndLink don't link to the subtrees found so far
+	void Clear();
+
 	Forest2Dag(LineForestHandler& f);
 };
 
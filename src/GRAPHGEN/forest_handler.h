@@ -7,7 +7,12 @@
 #ifndef GRAPHGEN_FOREST_HANDLER_H_
 #define GRAPHGEN_FOREST_HANDLER_H_
 
+#include <future>
+#include <thread>
+#include <vector>
+
 #include "output_generator.h"
+#include "pool.h"
 
 
 DEFINE_ENUM_CLASS_FLAGS(ForestHandlerFlags,
@@ -58,9 +63,11 @@ public:
         const pixel_set& ps,
         ForestHandlerFlags flag = ForestHandlerFlags::CENTER_LINES | ForestHandlerFlags::FIRST_LINE)
     {
+        std::vector<std::pair<ForestHandlerFlags, constraints>> groups;
+
         // Center lines forest generation
         if (ForestHandlerFlags::CENTER_LINES & flag) {
-            f_[ForestHandlerFlags::CENTER_LINES] = LineForestHandler(bd, ps);
+            groups.emplace_back(ForestHandlerFlags::CENTER_LINES, constraints{});
         }
 
         // First line forest generation
@@ -70,7 +77,7 @@ public:
                 if (p.GetDy() < 0)
                     first_line_constr[p.name_] = 0;
             }
-            f_[ForestHandlerFlags::FIRST_LINE] = LineForestHandler(bd, ps, first_line_constr);
+            groups.emplace_back(ForestHandlerFlags::FIRST_LINE, first_line_constr);
         }
         // Last line forest generation
         if (ForestHandlerFlags::LAST_LINE & flag) {
@@ -79,7 +86,7 @@ public:
                 if (p.GetDy() > 0)
                     last_line_constr[p.name_] = 0;
             }
-            f_[ForestHandlerFlags::LAST_LINE] = LineForestHandler(bd, ps, last_line_constr);
+            groups.emplace_back(ForestHandlerFlags::LAST_LINE, last_line_constr);
         }
         // Single line forest generation
         if (ForestHandlerFlags::SINGLE_LINE & flag) {
@@ -88,7 +95,35 @@ public:
                 if (p.GetDy() != 0)
                     single_line_constr[p.name_] = 0;
             }
-            f_[ForestHandlerFlags::SINGLE_LINE] = LineForestHandler(bd, ps, single_line_constr);
+            groups.emplace_back(ForestHandlerFlags::SINGLE_LINE, single_line_constr);
+        }
+
+        // Forest groups only read bd, so they are generated concurrently (drag_compressor forest_threads). Groups
+        // generated by the pool create their reduced trees serially, otherwise threads would multiply
+        size_t nthreads = conf.drag_compressor_forest_threads_;
+        if (nthreads == 0) {
+            nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        size_t group_threads = std::min(nthreads, groups.size());
+
+        std::vector<LineForestHandler> lfhs(groups.size());
+        if (group_threads <= 1) {
+            for (size_t i = 0; i < groups.size(); ++i) {
+                lfhs[i] = LineForestHandler(bd, ps, groups[i].second, nthreads);
+            }
+        }
+        else {
+            thread_pool pool(static_cast<unsigned>(groups.size()), group_threads);
+            std::vector<std::future<void>> generated;
+            for (size_t i = 0; i < groups.size(); ++i) {
+                generated.push_back(pool.enqueue_task([&, i]() { lfhs[i] = LineForestHandler(bd, ps, groups[i].second, 1); }));
+            }
+            for (auto& g : generated) {
+                g.get();
+            }
+        }
+        for (size_t i = 0; i < groups.size(); ++i) {
+            f_[groups[i].first] = std::move(lfhs[i]);
         }
     }
 
@@ -153,6 +188,9 @@ public:
 
     /** @brief Compresses all the drags of the forest using an exhaustive approach.
 
+    The main and end forests of all the groups are compressed concurrently, according to drag_compressor
+    forest_threads in the configuration. Their logs are printed in order, as in the sequential compression.
+
     @param[in] flags Flags to be used. Available flags are the ones from the DragCompressorFlags
                      enum class. Use the or to combine multiple flags. Default value is 
                      DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES.
@@ -161,9 +199,11 @@ public:
                           it will continue until end. Default value is -1.
     */
     void Compress(DragCompressorFlags flags = DragCompressorFlags::PRINT_STATUS_BAR | DragCompressorFlags::IGNORE_LEAVES, int iterations = - 1) {
-       for (auto& x : f_) {
-           DragCompressor(x.second, iterations, flags);
-       }
+        std::vector<DragCompressor::Forest> forests;
+        for (auto& x : f_) {
+            DragCompressor::AddForests(forests, x.second, names[x.first]);
+        }
+        DragCompressor::Compress(forests, iterations, flags);
     }
 
     LineForestHandler& GetLineForestHandler(ForestHandlerFlags forest_id) {
@@ -0,0 +1,211 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "frequency_table.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+namespace {
+
+void WriteVarint(ostream& os, uint64_t v) {
+    while (v >= 0x80) {
+        os.put(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    os.put(static_cast<char>(v));
+}
+
+bool ReadVarint(istream& is, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = is.get();
+        if (c == EOF) {
+            return false;
+        }
+        v |= uint64_t(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WriteString(ostream& os, const string& s) {
+    WriteVarint(os, s.size());
+    os.write(s.data(), s.size());
+}
+
+bool ReadString(istream& is, string& s) {
+    uint64_t size;
+    if (!ReadVarint(is, size) || size > 4096) {
+        return false;
+    }
+    s.resize(static_cast<size_t>(size));
+    return static_cast<bool>(is.read(s.data(), s.size()));
+}
+
+}
+
+FrequencyTable FrequencyTable::FromDense(const vector<unsigned long long>& freqs) {
+    FrequencyTable t;
+    for (size_t i = 0; i < freqs.size(); ++i) {
+        if (freqs[i] != 0) {
+            t.entries_.emplace_back(i, freqs[i]);
+        }
+    }
+    return t;
+}
+
+FrequencyTable FrequencyTable::FromSparse(const unordered_map<uint64_t, unsigned long long>& freqs) {
+    FrequencyTable t;
+    t.entries_.reserve(freqs.size());
+    for (const auto& [rule, count] : freqs) {
+        if (count != 0) {
+            t.entries_.emplace_back(rule, count);
+        }
+    }
+    sort(t.entries_.begin(), t.entries_.end());
+    return t;
+}
+
+void FrequencyTable::Add(const FrequencyTable& other) {
+    vector<Entry> merged;
+    merged.reserve(entries_.size() + other.entries_.size());
+    auto a = entries_.cbegin();
+    auto b = other.entries_.cbegin();
+    while (a != entries_.cend() && b != other.entries_.cend()) {
+        if (a->first < b->first) {
+            merged.push_back(*a++);
+        }
+        else if (b->first < a->first) {
+            merged.push_back(*b++);
+        }
+        else {
+            merged.emplace_back(a->first, a->second + b->second);
+            ++a;
+            ++b;
+        }
+    }
+    merged.insert(merged.end(), a, entries_.cend());
+    merged.insert(merged.end(), b, other.entries_.cend());
+    entries_ = move(merged);
+}
+
+void FrequencyTable::AddTo(rule_set& rs) const {
+    for (const auto& e : entries_) {
+        rs.rules[e.first].frequency += e.second;
+    }
+}
+
+bool FrequencyTable::Store(const filesystem::path& file, const string& mask_name, const rule_set& rs) const {
+    ofstream os(file, ios::binary);
+    if (!os) {
+        return false;
+    }
+    os.write(kMagic, strlen(kMagic));
+    WriteVarint(os, kVersion);
+    WriteString(os, mask_name);
+    WriteVarint(os, rs.conditions.size());
+    for (const auto& c : rs.conditions) {
+        WriteString(os, c);
+    }
+    WriteVarint(os, entries_.size());
+    uint64_t prev = 0;
+    for (const auto& e : entries_) {
+        WriteVarint(os, e.first - prev);
+        WriteVarint(os, e.second);
+        prev = e.first;
+    }
+    return static_cast<bool>(os);
+}
+
+bool FrequencyTable::Load(const filesystem::path& file, const string& mask_name, const rule_set& rs, bool& legacy) {
+    entries_.clear();
+    legacy = false;
+
+    ifstream is(file, ios::binary);
+    if (!is) {
+        return false;
+    }
+
+    char magic[sizeof(kMagic) - 1];
+    if (!is.read(magic, sizeof(magic)) || memcmp(magic, kMagic, sizeof(magic)) != 0) {
+        // Dense file of older versions
+        error_code ec;
+        if (filesystem::file_size(file, ec) != rs.rules.size() * 8 || ec) {
+            return false;
+        }
+        is.clear();
+        is.seekg(0);
+        for (size_t i = 0; i < rs.rules.size(); ++i) {
+            unsigned long long v;
+            if (!is.read(reinterpret_cast<char*>(&v), 8)) {
+                entries_.clear();
+                return false;
+            }
+            if (v != 0) {
+                entries_.emplace_back(i, v);
+            }
+        }
+        legacy = true;
+        return true;
+    }
+
+    uint64_t version, nconditions;
+    string name;
+    if (!ReadVarint(is, version) || version != kVersion || !ReadString(is, name) || name != mask_name ||
+        !ReadVarint(is, nconditions) || nconditions != rs.conditions.size()) {
+        return false;
+    }
+
+    // Bit of the rules of rs corresponding to each bit of the rules of the file
+    vector<size_t> bits;
+    bool same_order = true;
+    for (uint64_t i = 0; i < nconditions; ++i) {
+        string c;
+        if (!ReadString(is, c)) {
+            return false;
+        }
+        auto it = rs.conditions_pos.find(c);
+        if (it == rs.conditions_pos.end() || find(bits.begin(), bits.end(), it->second) != bits.end()) {
+            return false;
+        }
+        bits.push_back(it->second);
+        same_order = same_order && it->second == i;
+    }
+
+    uint64_t nentries;
+    if (!ReadVarint(is, nentries) || nentries > rs.rules.size()) {
+        return false;
+    }
+    entries_.reserve(static_cast<size_t>(nentries));
+    uint64_t rule = 0;
+    for (uint64_t i = 0; i < nentries; ++i) {
+        uint64_t delta, count;
+        if (!ReadVarint(is, delta) || !ReadVarint(is, count) || (i > 0 && delta == 0) || delta >= rs.rules.size() - rule) {
+            entries_.clear();
+            return false;
+        }
+        rule += delta;
+        uint64_t r = rule;
+        if (!same_order) {
+            r = 0;
+            for (size_t b = 0; b < bits.size(); ++b) {
+                r |= ((rule >> b) & 1) << bits[b];
+            }
+        }
+        entries_.emplace_back(r, count);
+    }
+    if (!same_order) {
+        sort(entries_.begin(), entries_.end());
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_FREQUENCY_TABLE_H_
+#define GRAPHGEN_FREQUENCY_TABLE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "rule_set.h"
+
+/** @brief Sparse table of the frequencies of the rules of a rule set.
+
+Only the rules which occur at least once are stored, as (rule, count) pairs sorted by rule, since most of the
+configurations of large masks never occur in real images. Tables are stored into file with the following format:
+- magic:         the 6 characters "GGFREQ";
+- version:       currently 1;
+- mask:          the name of the mask (pixel set) on which the frequencies were counted;
+- conditions:    the number of conditions followed by their names, in the order of the bits of the rule index;
+- entries:       the number of (rule, count) pairs followed by the pairs, each rule being stored as the
+                 difference from the previous one (from 0 for the first pair).
+Numbers are unsigned LEB128 varints and strings are stored as their length followed by their characters.
+Since the file lists the conditions, a table can be loaded into a rule set whose conditions are in a different
+order.
+*/
+class FrequencyTable {
+public:
+    using Entry = std::pair<uint64_t, unsigned long long>;
+
+    FrequencyTable() {}
+
+    /** @brief Builds the table of the non-zero elements of a dense histogram */
+    static FrequencyTable FromDense(const std::vector<unsigned long long>& freqs);
+
+    /** @brief Builds the table of a sparse histogram, which maps rules to their counts */
+    static FrequencyTable FromSparse(const std::unordered_map<uint64_t, unsigned long long>& freqs);
+
+    /** @brief Adds the counts of another table to this one */
+    void Add(const FrequencyTable& other);
+
+    /** @brief Adds the counts of the table to the frequencies of the rules of rs */
+    void AddTo(rule_set& rs) const;
+
+    /** @brief Stores the table into file, with the name of the mask and the conditions of rs. Returns false on error */
+    bool Store(const std::filesystem::path& file, const std::string& mask_name, const rule_set& rs) const;
+
+    /** @brief Loads a table stored with Store(), mapping its rules to the order of the conditions of rs.
+
+    Loading fails if the file has a different version or mask, or if its conditions are not those of rs. Files
+    of older versions of GRAPHGEN, which store one 8 bytes count for each rule in the order of rs, are read as
+    well, and legacy is set to true.
+    */
+    bool Load(const std::filesystem::path& file, const std::string& mask_name, const rule_set& rs, bool& legacy);
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    std::vector<Entry>::const_iterator begin() const { return entries_.begin(); }
+    std::vector<Entry>::const_iterator end() const { return entries_.end(); }
+
+private:
+    static constexpr char kMagic[] = "GGFREQ";
+    static constexpr uint64_t kVersion = 1;
+
+    std::vector<Entry> entries_;
+};
+
+#endif // !GRAPHGEN_FREQUENCY_TABLE_H_
@@ -1,8 +1,10 @@
 #ifndef GRAPHGEN_GRAPHGEN_H_
 #define GRAPHGEN_GRAPHGEN_H_
 
+#include "arena_drag.h"
 #include "base_ruleset.h"
 #include "conact_code_generator.h"
+#include "conact_drag_file.h"
 #include "conact_tree.h"
 #include "config_data.h"
 #include "connectivity_graph.h"
@@ -14,12 +16,16 @@
 #include "forest2dag.h"
 #include "forest_statistics.h"
 #include "forest_handler.h"
+#include "frequency_table.h"
 #include "graph_code_generator.h"
 #include "hypercube.h"
 #include "hypercube++.h"
+#include "mapped_hypercube.h"
 #include "collect_drag_stats.h"
 #include "merge_set.h"
+#include "odt_engine.h"
 #include "output_generator.h"
+#include "transposition_table.h"
 #include "tree2dag_identities.h"
 
 #ifdef GRAPHGEN_FREQUENCIES_ENABLED
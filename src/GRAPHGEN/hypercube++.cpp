@@ -6,28 +6,60 @@
 
 #include "hypercube++.h"
 
+#include <limits>
+
+#include "mapped_hypercube.h"
 #include "utilities.h"
 
 using namespace std;
 
 namespace hyper {
 
-void HyperCube::CreateTreeRec(BinaryDrag<conact>& t, BinaryDrag<conact>::node *n, size_t idx) const {
-    const Node& node = data_[idx];
-    if (node.actions_ == 0) {
-        n->data.t = conact::type::CONDITION;
-        n->data.condition = rs_.conditions[node.max_gain_index_];
+template <typename ActionSet, typename Counter>
+HyperCube<ActionSet, Counter>::HyperCube(const rule_set& rs)
+    : nbits_(rs.conditions.size()), rs_(rs), layout_(rs.conditions.size())
+{
+    // Frequencies and gains of the other levels are allocated when they are optimized
+    levels_.resize(nbits_ + 1);
+    for (size_t num_indif = 0; num_indif <= nbits_; ++num_indif) {
+        Level& l = levels_[num_indif];
+        size_t nnodes = layout_.LevelSize(num_indif);
+        l.actions_.resize(nnodes, 0);
+        l.max_gain_index_.resize(nnodes, 0);
+#ifdef HYPERCUBE_VERBOSE
+        l.num_equiv_.resize(nnodes, 0);
+#endif
+    }
+
+    // Level 0 has no indifferences, so the value of its nodes is the rule index
+    Level& l = levels_[0];
+    l.frequency_.resize(l.actions_.size(), 1);
+    l.gain_.resize(l.actions_.size(), 0);
+    auto nrules = rs.rules.size();
+    for (size_t i = 0; i < nrules; ++i) {
+        l.frequency_[i] = static_cast<Counter>(rs.rules[i].frequency);
+        l.actions_[i] = ToActionSet<ActionSet>(rs.rules[i].actions);
+    }
+}
 
-        size_t pow3 = pow3_[node.max_gain_index_];
-        size_t idx1 = idx - pow3;
-        size_t idx0 = idx1 - pow3;
+template <typename ActionSet, typename Counter>
+void HyperCube<ActionSet, Counter>::CreateTreeRec(BinaryDrag<conact>& t, BinaryDrag<conact>::node *n, size_t num_indif, uint32_t mask, size_t value) const {
+    const Level& l = levels_[num_indif];
+    size_t idx = layout_.Index(num_indif, mask, value);
+    if (l.actions_[idx] == 0) {
+        uint8_t p = l.max_gain_index_[idx];
+        n->data.t = conact::type::CONDITION;
+        n->data.condition = rs_.conditions[p];
 
-        CreateTreeRec(t, n->left = t.make_node(), idx0);
-        CreateTreeRec(t, n->right = t.make_node(), idx1);
+        // The children differ from the node in the condition p, which is inserted in their value
+        uint32_t child_mask = mask & ~(1u << p);
+        size_t s = p - PopCount(mask & ((1u << p) - 1));
+        CreateTreeRec(t, n->left = t.make_node(), num_indif - 1, child_mask, InsertBit(value, s, 0));
+        CreateTreeRec(t, n->right = t.make_node(), num_indif - 1, child_mask, InsertBit(value, s, 1));
     }
     else {
         n->data.t = conact::type::ACTION;
-        n->data.action = node.actions_;
+        n->data.action = ToBitset(l.actions_[idx]);
     }
 }
 
@@ -46,178 +78,214 @@ std::string BinaryWithIndifference(size_t value, size_t indif, size_t nbits) {
     return s;
 }
 
-#ifdef _MSC_VER
-static inline int __builtin_ctz(unsigned x) {
-    unsigned long ret;
-    _BitScanForward(&ret, x);
-    return (int)ret;
+#ifdef HYPERCUBE_VERBOSE
+template <typename ActionSet>
+static void PrintActions(const ActionSet& a) {
+    if (a == 0) {
+        std::cout << "0";
+    }
+    else {
+        auto actions = ToBitset(a);
+        for (size_t i = 1; i < 128; i++) {
+            if (actions[i - 1]) {
+                std::cout << i << ",";
+            }
+        }
+    }
+}
+
+template <typename ActionSet, typename Counter>
+void HyperCube<ActionSet, Counter>::PrintLevel(size_t num_indif)
+{
+    Level& cur = levels_[num_indif];
+    const Level& prev = levels_[num_indif - 1];
+    vector<uint32_t> masks = layout_.LevelMasks(num_indif);
+    size_t value_bits = nbits_ - num_indif;
+    for (size_t mask_rank = 0; mask_rank < masks.size(); ++mask_rank) {
+        uint32_t mask = masks[mask_rank];
+        for (size_t value = 0; value < (size_t(1) << value_bits); ++value) {
+            size_t idx = (mask_rank << value_bits) | value;
+            std::cout << BinaryWithIndifference(value, mask, nbits_) << "\t" << cur.frequency_[idx] << "\t";
+            PrintActions(cur.actions_[idx]);
+            std::cout << "\t";
+
+            // The gain of each condition is computed again from the children, in order to print
+            // it and to count the equivalent optimal trees
+            unsigned max_num_equiv = 0;
+            Counter max_gain = 0;
+            for (uint8_t p = 0; p < nbits_; ++p) {
+                if (((mask >> p) & 1) == 0) {
+                    continue;
+                }
+                size_t s = p - PopCount(mask & ((1u << p) - 1));
+                size_t idx0 = layout_.Index(num_indif - 1, mask & ~(1u << p), InsertBit(value, s, 0));
+                size_t idx1 = layout_.Index(num_indif - 1, mask & ~(1u << p), InsertBit(value, s, 1));
+                ActionSet actions = prev.actions_[idx0] & prev.actions_[idx1];
+                Counter gain = prev.gain_[idx0] + prev.gain_[idx1];
+                unsigned num_equiv = 0;
+                if (actions != 0) {
+                    gain += prev.frequency_[idx0] + prev.frequency_[idx1];
+                }
+                else {
+                    num_equiv = prev.num_equiv_[idx0] * prev.num_equiv_[idx1];
+                }
+                if (max_gain == gain) {
+                    num_equiv += max_num_equiv;
+                }
+                if (max_gain <= gain) {
+                    max_gain = gain;
+                    max_num_equiv = num_equiv;
+                }
+
+                std::cout << gain;
+                if (p == cur.max_gain_index_[idx])
+                    std::cout << "*";
+                else if (gain == cur.gain_[idx])
+                    std::cout << "#";
+                std::cout << "\t";
+            }
+            cur.num_equiv_[idx] = std::max(max_num_equiv, 1u);
+            std::cout << cur.num_equiv_[idx] << "\n";
+        }
+        std::cout << "\n";
+    }
 }
 #endif
 
-//#define HYPERCUBE_VERBOSE
-BinaryDrag<conact> HyperCube::Optimize()
+template <typename ActionSet, typename Counter>
+BinaryDrag<conact> HyperCube<ActionSet, Counter>::Optimize(size_t nthreads, KernelIsa isa)
 {
 #ifdef HYPERCUBE_VERBOSE
     // Print the table
     for (size_t i = 0; i < 1ull << nbits_; ++i) {
-        size_t idx = GetIndex(i);
-        std::cout << BinaryWithIndifference(i, 0, nbits_) << "\t" << data_[idx].frequency_ << "\t";
-        if (data_[idx].actions_ == 0) {
-            std::cout << "0";
-        }
-        else {
-            for (size_t i = 1; i < 128; i++) {
-                if (data_[idx].actions_[i - 1]) {
-                    std::cout << i << ",";
-                }
-            }
-        }
+        std::cout << BinaryWithIndifference(i, 0, nbits_) << "\t" << levels_[0].frequency_[i] << "\t";
+        PrintActions(levels_[0].actions_[i]);
         std::cout << "\n";
     }
     std::cout << "------------------------\n";
 #endif
 
+    if (nthreads == 0) {
+        nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    std::unique_ptr<thread_pool> pool;
+    if (nthreads > 1) {
+        pool = std::make_unique<thread_pool>(static_cast<unsigned>(nthreads * 4), nthreads);
+    }
+
+    CombineKernel<ActionSet, Counter> kernel = GetCombineKernel<ActionSet, Counter>(isa);
+    PerformanceEvaluator level_pe;
     for (size_t num_indif = 1; num_indif <= nbits_; num_indif++) {
+        level_pe.start();
+        levels_[num_indif].AllocateCounters();
+        OptimizeLevel(layout_, num_indif, levels_[num_indif - 1].cells(), levels_[num_indif].cells(), kernel, pool.get(), nthreads);
         #ifndef HYPERCUBE_VERBOSE
-            std::cout << num_indif << " " << std::flush;
-        #endif
-        // Initialize the Indifferences
-        int indif = (1 << num_indif) - 1;
-        int last = indif << (nbits_ - num_indif);
-
-        // Do all permutations of indifferences
-        while (true) {
-            // use permutation
-
-            int max_value = 1 << (nbits_ - num_indif);
-            for (int i = 0; i < max_value; ++i) {
-                #ifdef HYPERCUBE_VERBOSE
-                vector<Node> nodes_;
-                #endif
-
-                size_t idx = GetIndexWithIndifference(i, indif);
-                int tmp_indif = indif;
-                int pos_indif = 0;
-                Node& max_gain_node = data_[idx];
-                while (tmp_indif>0) { // there are more indifferences to check
-                    if (tmp_indif & 1) { // this is and indifference
-                        size_t pow3 = pow3_[pos_indif];
-                        size_t idx1 = idx - pow3;
-                        size_t idx0 = idx1 - pow3;
-
-                        Node& node0 = data_[idx0], node1 = data_[idx1];
-
-                        Node cur_node;
-                        cur_node.actions_ = node0.actions_ & node1.actions_;
-                        cur_node.frequency_ = node0.frequency_ + node1.frequency_;
-                        cur_node.gain_ = node0.gain_ + node1.gain_;
-                        cur_node.max_gain_index_ = pos_indif;
-                        if (cur_node.actions_ != 0) {
-                            cur_node.gain_ += cur_node.frequency_;
-                            cur_node.num_equiv_ = 0;
-                        }
-                        else {
-                            cur_node.num_equiv_ = node0.num_equiv_ * node1.num_equiv_;
-                        }
-
-                        #ifdef HYPERCUBE_VERBOSE
-                        nodes_.push_back(cur_node);
-                        #endif
-
-                        if (max_gain_node.gain_ <= cur_node.gain_) {
-                            if (max_gain_node.gain_ == cur_node.gain_) {
-                                cur_node.num_equiv_ += max_gain_node.num_equiv_;
-                            }
-                            max_gain_node = cur_node;
-                        }
-                    }
-
-                    ++pos_indif;
-                    tmp_indif >>= 1;
-                }
-                max_gain_node.num_equiv_ = std::max(max_gain_node.num_equiv_, 1u);
-
-                #ifdef HYPERCUBE_VERBOSE
-                std::cout << BinaryWithIndifference(i, indif, nbits_) << "\t" << data_[idx].frequency_ << "\t";
-                if (data_[idx].actions_ == 0) {
-                    std::cout << "0";
-                }
-                else {
-                    for (size_t i = 1; i < 128; i++) {
-                        if (data_[idx].actions_[i - 1]) {
-                            std::cout << i << ",";
-                        }
-                    }
-                }
-                std::cout << "\t";
-                for (const auto& x : nodes_) {
-                    std::cout << x.gain_;
-                    if (x.max_gain_index_ == max_gain_node.max_gain_index_)
-                        std::cout << "*";
-                    else if (x.gain_ == max_gain_node.gain_)
-                        std::cout << "#";
-                    std::cout << "\t";
-                }
-                std::cout << max_gain_node.num_equiv_ << "\n";
-                #endif
-            }
-            #ifdef HYPERCUBE_VERBOSE
-            std::cout << "\n";
-            #endif
-
-            // check if last
-            if (indif == last)
-                break;
-
-            // next permutation (https://graphics.stanford.edu/~seander/bithacks.html#NextBitPermutation)
-            int t = indif | (indif - 1);
-            indif = (t + 1) | (((~t & -~t) - 1) >> (__builtin_ctz(indif) + 1));
-        } 
-        #ifdef HYPERCUBE_VERBOSE
+            std::cout << num_indif << " (" << level_pe.stop() << " ms) " << std::flush;
+        #else
+            PrintLevel(num_indif);
             std::cout << "------------------------\n";
         #endif
+        // Frequencies and gains of the previous level are not required anymore
+        levels_[num_indif - 1].ReleaseCounters();
     }
 
     BinaryDrag<conact> t;
-    CreateTreeRec(t, t.make_root(), data_.size() - 1);
+    CreateTreeRec(t, t.make_root(), nbits_, (uint32_t)((uint64_t(1) << nbits_) - 1), 0);
     return t;
 }
 
-BinaryDrag<conact> GenerateOdt(const rule_set& rs) {
-    TLOG("Allocating hypercube",
-        HyperCube hcube(rs);
+template class HyperCube<uint16_t, uint32_t>;
+template class HyperCube<uint16_t, uint64_t>;
+template class HyperCube<uint32_t, uint32_t>;
+template class HyperCube<uint32_t, uint64_t>;
+template class HyperCube<uint64_t, uint32_t>;
+template class HyperCube<uint64_t, uint64_t>;
+template class HyperCube<std::bitset<131>, uint32_t>;
+template class HyperCube<std::bitset<131>, uint64_t>;
+
+template <typename ActionSet, typename Counter>
+static BinaryDrag<conact> OptimizeHyperCube(const rule_set& rs, size_t nthreads, KernelIsa isa) {
+    using HyperCubeType = HyperCube<ActionSet, Counter>;
+    size_t nnodes = static_cast<size_t>(pow(3.0, rs.conditions.size()));
+    string msg = "Allocating hypercube (" + to_string(nnodes * HyperCubeType::NodeSize() / (1 << 20)) + " MB)";
+    TLOG(msg,
+        HyperCubeType hcube(rs);
     );
 
     TLOG("Optimizing rules",
-        auto t = hcube.Optimize();
+        auto t = hcube.Optimize(nthreads, isa);
     );
 
     return t;
 }
 
-BinaryDrag<conact> GenerateOdt(const rule_set& rs, const string& filename)
-{
-    auto t = GenerateOdt(rs);
-    WriteConactTree(t, filename);
+template <typename ActionSet, typename Counter>
+static BinaryDrag<conact> OptimizeMappedHyperCube(const rule_set& rs, const filesystem::path& directory, size_t nthreads) {
+    using HyperCubeType = MappedHyperCube<ActionSet, Counter>;
+    size_t nnodes = static_cast<size_t>(pow(3.0, rs.conditions.size()));
+    string msg = "Mapping hypercube in " + directory.string() + " (" + to_string(nnodes * HyperCubeType::NodeSize() / (1 << 20)) + " MB)";
+    TLOG(msg,
+        HyperCubeType hcube(rs, directory);
+    );
+
+    TLOG("Optimizing rules",
+        auto t = hcube.Optimize(nthreads);
+    );
+
     return t;
 }
 
-BinaryDrag<conact> GetOdt(const rule_set& rs, bool force_generation) {
-    string odt_filename = conf.odt_path_.string();
-    BinaryDrag<conact> t;
-    if (conf.force_odt_generation_ || force_generation || !LoadConactTree(t, odt_filename)) {
-        t = GenerateOdt(rs, odt_filename);
+template <typename T>
+struct TypeTag {
+    using type = T;
+};
+
+// Calls f(TypeTag<ActionSet>, TypeTag<Counter>) with the smallest types able to store the
+// actions and the gains of the hypercube. The gain of a node is at most the total frequency
+// of the rules multiplied by the number of levels.
+template <typename F>
+static BinaryDrag<conact> DispatchNodeTypes(const rule_set& rs, F f) {
+    long double max_gain = 0;
+    for (const auto& r : rs.rules) {
+        max_gain += r.frequency;
     }
-    return t;
-}
+    max_gain *= rs.conditions.size() + 1;
+    bool small_counter = max_gain <= numeric_limits<uint32_t>::max();
 
-BinaryDrag<conact> GetOdtWithFileSuffix(const rule_set& rs, const string& file_suffix, bool force_generation) {
-    string odt_filename = conf.GetCustomOdtPath(file_suffix).string();
-    BinaryDrag<conact> t;
-    if (conf.force_odt_generation_ || force_generation || !LoadConactTree(t, odt_filename)) {
-        t = GenerateOdt(rs, odt_filename);
+    auto with_actions = [&](auto action_set) {
+        if (small_counter) {
+            return f(action_set, TypeTag<uint32_t>{});
+        }
+        return f(action_set, TypeTag<uint64_t>{});
+    };
+
+    size_t nactions = rs.actions.size();
+    if (nactions <= 16) {
+        return with_actions(TypeTag<uint16_t>{});
     }
-    return t;
+    else if (nactions <= 32) {
+        return with_actions(TypeTag<uint32_t>{});
+    }
+    else if (nactions <= 64) {
+        return with_actions(TypeTag<uint64_t>{});
+    }
+    return with_actions(TypeTag<std::bitset<131>>{});
+}
+
+BinaryDrag<conact> GenerateOdt(const rule_set& rs, size_t nthreads, KernelIsa isa) {
+    return DispatchNodeTypes(rs, [&](auto action_set, auto counter) {
+        using ActionSet = typename decltype(action_set)::type;
+        using Counter = typename decltype(counter)::type;
+        return OptimizeHyperCube<ActionSet, Counter>(rs, nthreads, isa);
+    });
+}
+
+BinaryDrag<conact> GenerateOdtOutOfCore(const rule_set& rs, const filesystem::path& directory, size_t nthreads) {
+    return DispatchNodeTypes(rs, [&](auto action_set, auto counter) {
+        using ActionSet = typename decltype(action_set)::type;
+        using Counter = typename decltype(counter)::type;
+        return OptimizeMappedHyperCube<ActionSet, Counter>(rs, directory, nthreads);
+    });
 }
 
-}
\ No newline at end of file
+}
@@ -8,135 +8,173 @@
 #define GRAPHGEN_HYPERCUBEPP_H_
 
 #include <algorithm>
+#include <bitset>
 #include <cassert>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <type_traits>
+#include <vector>
 
 #include "conact_tree.h"
+#include "hypercube_kernel.h"
+#include "hypercube_level.h"
+#include "pool.h"
 #include "rule_set.h"
 
 namespace hyper {
 
-template <typename T>
-std::istream& rawread(std::istream& is, T& val, size_t n) {
-    return is.read(reinterpret_cast<char*>(&val), n);
+// Converts the actions of a rule into the ActionSet used by the hypercube
+template <typename ActionSet>
+inline ActionSet ToActionSet(const std::bitset<131>& actions) {
+    if constexpr (std::is_integral_v<ActionSet>) {
+        return static_cast<ActionSet>(actions.to_ullong());
+    }
+    else {
+        return actions;
+    }
 }
-template <typename T>
-std::ostream& rawwrite(std::ostream& os, const T& val, size_t n) {
-    return os.write(reinterpret_cast<const char*>(&val), n);
+
+// Converts an ActionSet of the hypercube into the actions of a conact
+template <typename ActionSet>
+inline std::bitset<131> ToBitset(const ActionSet& actions) {
+    if constexpr (std::is_integral_v<ActionSet>) {
+        return std::bitset<131>(static_cast<unsigned long long>(actions));
+    }
+    else {
+        return actions;
+    }
 }
 
+//#define HYPERCUBE_VERBOSE
+
+/** @brief Hypercube used to generate the Optimal Decision Tree associated to a rule set.
+
+The nodes of the hypercube are grouped by level (number of indifferences), with the layout
+described by LevelLayout, and each level is stored as a structure of arrays: actions, 
+frequencies, gains and best conditions of its nodes are kept in separate dense vectors. The 
+children of consecutive nodes through the same indifference are thus mostly consecutive too, 
+and they are combined in runs by the vectorized kernels of hypercube_kernel.h (see 
+hyper::OptimizeLevel()). Frequencies and gains are only required to optimize the next level,
+so they are allocated when a level is optimized and released when the next one is completed:
+besides actions and best conditions, only the counters of two levels are kept in memory.
+
+The type used to store the set of actions of a node (ActionSet) and the type used to store
+frequencies and gains (Counter) are template parameters, so that the memory footprint of each
+node can be fitted to the rule set: for example, a rule set with 16 actions and no frequencies
+only requires an uint16_t and two uint32_t per node. GenerateOdt() automatically selects the
+smallest types that fit the given rule set.
+
+ActionSet can be an unsigned integral type or a std::bitset, Counter must be an unsigned
+integral type.
+*/
+template <typename ActionSet, typename Counter>
 class HyperCube {
-    size_t GetIndexWithIndifference(size_t value, size_t indif) {
-        size_t index = 0;
-        int vbits = 0;
-        for (size_t pos = 0; pos < nbits_; ++pos) {
-            if ((indif >> pos) & 1) {
-                index += 2 * pow3_[pos];
-            }
-            else {
-                index += ((value >> vbits) & 1)*pow3_[pos];
-                ++vbits;
-            }
+    struct Level {
+        std::vector<ActionSet> actions_;
+        std::vector<uint8_t> max_gain_index_;
+        std::vector<Counter> frequency_;
+        std::vector<Counter> gain_;
+#ifdef HYPERCUBE_VERBOSE
+        // The number of equivalent optimal trees is only displayed, so it is not stored otherwise
+        std::vector<unsigned> num_equiv_;
+#endif
+
+        LevelCells<ActionSet, Counter> cells() {
+            return { actions_.data(), max_gain_index_.data(), frequency_.data(), gain_.data() };
         }
-        return index;
-    }
 
-    size_t GetIndex(size_t value) {
-        size_t index = 0;
-        for (int pos = 0; pos < static_cast<int>(nbits_); ++pos) {
-            index += ((value >> pos) & 1)*pow3_[pos];
+        void AllocateCounters() {
+            frequency_.resize(actions_.size());
+            gain_.resize(actions_.size());
         }
-        return index;
-    }
 
-    void CreateTreeRec(BinaryDrag<conact>& t, BinaryDrag<conact>::node *n, size_t idx) const;
+        /** @brief Frees frequencies and gains */
+        void ReleaseCounters() {
+            std::vector<Counter>().swap(frequency_);
+            std::vector<Counter>().swap(gain_);
+        }
+    };
 
-public:
+    void CreateTreeRec(BinaryDrag<conact>& t, BinaryDrag<conact>::node *n, size_t num_indif, uint32_t mask, size_t value) const;
 
-#pragma pack(push)
-#pragma pack(1)
-    struct Node {
-        std::bitset<131/*CTBE needs 131 bits*/> actions_ = 0;
-        unsigned long long frequency_ = 1;
-        unsigned long long gain_ = 0;
-        uint8_t max_gain_index_ = 0;
-        unsigned int num_equiv_ = 0;
-    };
-#pragma pack(pop)
+#ifdef HYPERCUBE_VERBOSE
+    // Prints the nodes of a level which has just been optimized, with the gain of every condition
+    void PrintLevel(size_t num_indif);
+#endif
+
+public:
 
     size_t nbits_;
-    std::vector<Node> data_;
     const rule_set& rs_;
-    std::vector<size_t> pow3_;
-
-    HyperCube(const rule_set& rs) 
-        : rs_(rs), nbits_(rs.conditions.size()), 
-        data_(size_t(pow(3.0, rs.conditions.size()))), pow3_(rs.conditions.size())
-    {
-        // Initialize vector of powers of 3
-        pow3_[0] = 1;
-        for (size_t i = 1; i < nbits_; ++i) {
-            pow3_[i] = pow3_[i - 1] * 3;
-        }
+    LevelLayout layout_;
+    std::vector<Level> levels_;
 
-        // Initialize hypercube nodes using the rules defined in the ruleset
-        auto nrules = rs.rules.size();
-        for (size_t i = 0; i < nrules; ++i) {
-            // for each rule generate the hypercube index
-            size_t idx = GetIndex(i);
-            // and set its values
-            data_[idx].frequency_ = rs.rules[i].frequency;
-            data_[idx].actions_ = rs.rules[i].actions;
-        }
-    }
+    HyperCube(const rule_set& rs);
 
+    // Only actions and max gain indexes are stored, since counters are not kept after the optimization (see
+    // AllocateCounters). Levels are always allocated, so the stream has the same layout before and after Optimize()
     std::istream& read(std::istream& is) {
-        return rawread(is, data_[0], data_.size() * sizeof(Node));
+        for (auto& l : levels_) {
+            is.read(reinterpret_cast<char*>(l.actions_.data()), l.actions_.size() * sizeof(ActionSet));
+            is.read(reinterpret_cast<char*>(l.max_gain_index_.data()), l.max_gain_index_.size() * sizeof(uint8_t));
+        }
+        return is;
     }
-    std::ostream& write(std::ostream& os) {
-        return rawwrite(os, data_[0], data_.size() * sizeof(Node));
+    std::ostream& write(std::ostream& os) const {
+        for (const auto& l : levels_) {
+            os.write(reinterpret_cast<const char*>(l.actions_.data()), l.actions_.size() * sizeof(ActionSet));
+            os.write(reinterpret_cast<const char*>(l.max_gain_index_.data()), l.max_gain_index_.size() * sizeof(uint8_t));
+        }
+        return os;
     }
 
-    Node& operator[](size_t idx) { return data_[idx]; }
-    const Node& operator[](size_t idx) const { return data_[idx]; }
-
-    BinaryDrag<conact> Optimize();
-};
-
-// Generates an Optimal Decision Tree from the given rule_set,
-// and store it in the filename when specified.
-BinaryDrag<conact> GenerateOdt(const rule_set& rs);
-BinaryDrag<conact> GenerateOdt(const rule_set& rs, const std::string& filename);
+    size_t size() const { return layout_.Size(); }
 
-/** @brief Returns the optimal (or pseudo optimal) decision tree generated from the given rule set
+    /** @brief Returns the number of bytes required to store a node of the hypercube, counters
+    included (so it is an upper bound, since counters are only kept for two levels) */
+    static constexpr size_t NodeSize() {
+        return sizeof(ActionSet) + 2 * sizeof(Counter) + sizeof(uint8_t)
+#ifdef HYPERCUBE_VERBOSE
+            + sizeof(unsigned)
+#endif
+            ;
+    }
 
-This function generates the optimal decision tree from the given rule set. When the number
-of rules is too high, a pseudo optimal tree is generated. If the tree has already been generated, it
-is loaded from file, unless the "force_generation" parameter is set to true. In this case the tree
-is always regenerated. The loaded/generated tree is then returned from the function.
+    /** @brief Optimizes the hypercube and returns the corresponding decision tree.
 
-@param[in] rs Rule set from which generate the decision tree.
-@param[in] force_generation Whether the tree must be generated or can be loaded from file.
+    Every level of the hypercube (i.e. all the nodes with the same number of indifferences)
+    only depends on the previous one, so when nthreads is greater than one each level is
+    split among nthreads threads, with a barrier between consecutive levels. The generated 
+    tree is the same regardless of the number of threads and of the combine kernel. The time
+    spent on each level is printed on the standard output.
 
-@return The optimal decision tree associated to the specified rule set.
-*/
-BinaryDrag<conact> GetOdt(const rule_set& rs, bool force_generation = false);
+    @param[in] nthreads Number of threads used to optimize each level. 0 means one thread
+                        for each hardware core. Default value is 1 (serial optimization).
+    @param[in] isa Instruction set of the combine kernel (see GetCombineKernel()). By default
+                   the best one supported by the CPU is used.
 
+    @return The optimal decision tree associated to the hypercube's rule set.
+    */
+    BinaryDrag<conact> Optimize(size_t nthreads = 1, KernelIsa isa = DetectKernelIsa());
+};
 
-/** @brief Returns the optimal (or pseudo optimal) decision tree generated from the given rule set
+/** @brief Generates the Optimal Decision Tree of the given rule set with an in-core HyperCube.
 
-This function generates the optimal decision tree from the given rule set. When the number
-of rules is too high, a pseudo optimal tree is generated. If the tree has already been generated, it
-is loaded from file, unless the "force_generation" parameter is set to true. In this case the tree
-is always regenerated. The loaded/generated tree is then returned from the function.
+The hypercube uses the smallest node types that fit the rule set.
 
 @param[in] rs Rule set from which generate the decision tree.
-@param[in] file_suffix Suffix that is appended to the file name of the decision tree file.
-@param[in] force_generation Whether the tree must be generated or can be loaded from file.
+@param[in] nthreads Number of threads used to optimize each level, see HyperCube::Optimize().
+@param[in] isa Instruction set of the combine kernel, see HyperCube::Optimize().
 
 @return The optimal decision tree associated to the specified rule set.
 */
-BinaryDrag<conact> GetOdtWithFileSuffix(const rule_set& rs, const std::string& file_suffix, bool force_generation = false);
+BinaryDrag<conact> GenerateOdt(const rule_set& rs, size_t nthreads = 1, KernelIsa isa = DetectKernelIsa());
+
+/** @brief Generates the Optimal Decision Tree of the given rule set with a MappedHyperCube,
+whose files are stored in directory. See GenerateOdt() for the other parameters.
+*/
+BinaryDrag<conact> GenerateOdtOutOfCore(const rule_set& rs, const std::filesystem::path& directory, size_t nthreads = 1);
 
 }
 
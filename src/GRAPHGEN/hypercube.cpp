@@ -175,40 +175,3 @@ BinaryDrag<conact> VHyperCube::optimize(bool bVerbose)
 	CreateTree_rec(t, t.make_root(), m_rs, *this, string(m_iDim, '-'));
 	return t;
 }
-
-BinaryDrag<conact> GenerateOdt(const rule_set& rs) {
-    TLOG("Allocating hypercube",
-        VHyperCube hcube(rs);
-    );
-
-    TLOG("Optimizing rules",
-        auto t = hcube.optimize(false);
-    );
-
-    return t;
-}
-
-BinaryDrag<conact> GenerateOdt(const rule_set& rs, const string& filename) 
-{
-    auto t = GenerateOdt(rs);
-	WriteConactTree(t, filename);
-	return t;
-}
-
-BinaryDrag<conact> GetOdt(const rule_set& rs, bool force_generation) {
-    string odt_filename = conf.odt_path_.string();
-    BinaryDrag<conact> t;
-    if (conf.force_odt_generation_ || force_generation || !LoadConactTree(t, odt_filename)) {
-        t = GenerateOdt(rs, odt_filename);
-    }
-    return t;
-}
-
-BinaryDrag<conact> GetOdtWithFileSuffix(const rule_set& rs, const string& file_suffix, bool force_generation) {
-    string odt_filename = conf.GetCustomOdtPath(file_suffix).string();
-    BinaryDrag<conact> t;
-    if (conf.force_odt_generation_ || force_generation || !LoadConactTree(t, odt_filename)) {
-        t = GenerateOdt(rs, odt_filename);
-    }
-    return t;
-}
\ No newline at end of file
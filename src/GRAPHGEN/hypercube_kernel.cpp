@@ -0,0 +1,350 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "hypercube_kernel.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GRAPHGEN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Kernels are compiled for their instruction set regardless of the compiler flags, and
+// selected at runtime. MSVC doesn't need (and doesn't support) per function targets.
+#if defined(GRAPHGEN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GRAPHGEN_TARGET_AVX2 __attribute__((target("avx2")))
+#define GRAPHGEN_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw,avx512vl")))
+#else
+#define GRAPHGEN_TARGET_AVX2
+#define GRAPHGEN_TARGET_AVX512
+#endif
+
+using namespace std;
+
+namespace hyper {
+
+const char* KernelIsaName(KernelIsa isa) {
+    switch (isa) {
+    case KernelIsa::AVX2:   return "avx2";
+    case KernelIsa::AVX512: return "avx512";
+    default:                return "scalar";
+    }
+}
+
+KernelIsa DetectKernelIsa() {
+#if defined(GRAPHGEN_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")) {
+        return KernelIsa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return KernelIsa::AVX2;
+    }
+#elif defined(GRAPHGEN_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] >> 27) & 1;
+        bool avx = (info[2] >> 28) & 1;
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] >> 5) & 1;
+        bool avx512 = ((info[1] >> 16) & 1) && ((info[1] >> 30) & 1) && ((info[1] >> 31) & 1); // F, BW, VL
+        if (avx && avx512 && (xcr0 & 0xe6) == 0xe6) {
+            return KernelIsa::AVX512;
+        }
+        if (avx && avx2 && (xcr0 & 0x6) == 0x6) {
+            return KernelIsa::AVX2;
+        }
+    }
+#endif
+    return KernelIsa::SCALAR;
+}
+
+#ifdef GRAPHGEN_X86
+
+// Cells which don't fill a whole vector are combined by the scalar kernel
+template <typename ActionSet, typename Counter>
+static void CombineTail(const CombineCells<ActionSet, Counter>& c, size_t first) {
+    CombineCells<ActionSet, Counter> tail = c;
+    tail.n = c.n - first;
+    tail.actions0 += first;
+    tail.actions1 += first;
+    tail.frequency0 += first;
+    tail.frequency1 += first;
+    tail.gain0 += first;
+    tail.gain1 += first;
+    tail.actions += first;
+    tail.frequency += first;
+    tail.gain += first;
+    tail.max_gain_index += first;
+    CombineCellsScalar(tail);
+}
+
+// AVX2, 32 bits counters: 8 cells per iteration. The update mask is computed on the 32 bits
+// lanes of the counters and then packed to the width of actions and indexes.
+template <typename ActionSet>
+GRAPHGEN_TARGET_AVX2 static void CombineAvx2Counter32(const CombineCells<ActionSet, uint32_t>& c) {
+    static_assert(sizeof(ActionSet) == 2 || sizeof(ActionSet) == 4, "unsupported ActionSet");
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m128i index = _mm_set1_epi8(static_cast<char>(c.index));
+    size_t i = 0;
+    for (; i + 8 <= c.n; i += 8) {
+        __m256i nonzero;
+        __m128i actions16;
+        __m256i actions32;
+        if constexpr (sizeof(ActionSet) == 2) {
+            actions16 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions0 + i)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions1 + i)));
+            nonzero = _mm256_xor_si256(_mm256_cvtepi16_epi32(_mm_cmpeq_epi16(actions16, _mm_setzero_si128())), ones);
+        }
+        else {
+            actions32 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions0 + i)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions1 + i)));
+            nonzero = _mm256_xor_si256(_mm256_cmpeq_epi32(actions32, _mm256_setzero_si256()), ones);
+        }
+
+        __m256i frequency = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency0 + i)),
+                                             _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency1 + i)));
+        __m256i gain = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain0 + i)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain1 + i)));
+        gain = _mm256_add_epi32(gain, _mm256_and_si256(frequency, nonzero));
+
+        __m256i max_gain = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain + i));
+        __m256i update = _mm256_cmpeq_epi32(_mm256_max_epu32(max_gain, gain), gain); // max_gain <= gain
+
+        __m256i max_frequency = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(c.frequency + i), _mm256_blendv_epi8(max_frequency, frequency, update));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(c.gain + i), _mm256_blendv_epi8(max_gain, gain, update));
+
+        __m128i update16 = _mm_packs_epi32(_mm256_castsi256_si128(update), _mm256_extracti128_si256(update, 1));
+        if constexpr (sizeof(ActionSet) == 2) {
+            __m128i max_actions = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(c.actions + i), _mm_blendv_epi8(max_actions, actions16, update16));
+        }
+        else {
+            __m256i max_actions = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(c.actions + i), _mm256_blendv_epi8(max_actions, actions32, update));
+        }
+
+        __m128i update8 = _mm_packs_epi16(update16, update16);
+        __m128i max_gain_index = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.max_gain_index + i));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(c.max_gain_index + i), _mm_blendv_epi8(max_gain_index, index, update8));
+    }
+    CombineTail(c, i);
+}
+
+// AVX2, 64 bits counters: 4 cells per iteration. AVX2 has no unsigned 64 bits comparison, so
+// it is obtained flipping the sign bit of both operands.
+template <typename ActionSet>
+GRAPHGEN_TARGET_AVX2 static void CombineAvx2Counter64(const CombineCells<ActionSet, uint64_t>& c) {
+    static_assert(sizeof(ActionSet) == 2 || sizeof(ActionSet) == 4 || sizeof(ActionSet) == 8, "unsupported ActionSet");
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i sign = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ull));
+    const __m256i even_lanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const __m128i index = _mm_set1_epi8(static_cast<char>(c.index));
+    size_t i = 0;
+    for (; i + 4 <= c.n; i += 4) {
+        __m256i nonzero;
+        __m128i actions_small;
+        __m256i actions64;
+        if constexpr (sizeof(ActionSet) == 2) {
+            actions_small = _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.actions0 + i)),
+                                          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.actions1 + i)));
+            nonzero = _mm256_xor_si256(_mm256_cvtepi16_epi64(_mm_cmpeq_epi16(actions_small, _mm_setzero_si128())), ones);
+        }
+        else if constexpr (sizeof(ActionSet) == 4) {
+            actions_small = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions0 + i)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions1 + i)));
+            nonzero = _mm256_xor_si256(_mm256_cvtepi32_epi64(_mm_cmpeq_epi32(actions_small, _mm_setzero_si128())), ones);
+        }
+        else {
+            actions64 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions0 + i)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions1 + i)));
+            nonzero = _mm256_xor_si256(_mm256_cmpeq_epi64(actions64, _mm256_setzero_si256()), ones);
+        }
+
+        __m256i frequency = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency0 + i)),
+                                             _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency1 + i)));
+        __m256i gain = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain0 + i)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain1 + i)));
+        gain = _mm256_add_epi64(gain, _mm256_and_si256(frequency, nonzero));
+
+        __m256i max_gain = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain + i));
+        __m256i keep = _mm256_cmpgt_epi64(_mm256_xor_si256(max_gain, sign), _mm256_xor_si256(gain, sign)); // max_gain > gain
+
+        __m256i max_frequency = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(c.frequency + i), _mm256_blendv_epi8(frequency, max_frequency, keep));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(c.gain + i), _mm256_blendv_epi8(gain, max_gain, keep));
+
+        __m128i keep32 = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(keep, even_lanes));
+        __m128i keep16 = _mm_packs_epi32(keep32, keep32);
+        if constexpr (sizeof(ActionSet) == 2) {
+            __m128i max_actions = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.actions + i));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(c.actions + i), _mm_blendv_epi8(actions_small, max_actions, keep16));
+        }
+        else if constexpr (sizeof(ActionSet) == 4) {
+            __m128i max_actions = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(c.actions + i), _mm_blendv_epi8(actions_small, max_actions, keep32));
+        }
+        else {
+            __m256i max_actions = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(c.actions + i), _mm256_blendv_epi8(actions64, max_actions, keep));
+        }
+
+        __m128i keep8 = _mm_packs_epi16(keep16, keep16);
+        int32_t old_index;
+        memcpy(&old_index, c.max_gain_index + i, sizeof(old_index));
+        int32_t new_index = _mm_cvtsi128_si32(_mm_blendv_epi8(index, _mm_cvtsi32_si128(old_index), keep8));
+        memcpy(c.max_gain_index + i, &new_index, sizeof(new_index));
+    }
+    CombineTail(c, i);
+}
+
+// AVX-512: 16 cells per iteration with 32 bits counters, 8 cells with 64 bits counters or
+// actions. The update is a mask register, which is used to blend the new values with the
+// current ones (blend and store is faster than a masked store).
+template <typename ActionSet, typename Counter>
+GRAPHGEN_TARGET_AVX512 static void CombineAvx512(const CombineCells<ActionSet, Counter>& c) {
+    static_assert(sizeof(ActionSet) == 2 || sizeof(ActionSet) == 4 || sizeof(ActionSet) == 8, "unsupported ActionSet");
+    constexpr size_t lanes = (sizeof(ActionSet) == 8 || sizeof(Counter) == 8) ? 8 : 16;
+    const __m128i index = _mm_set1_epi8(static_cast<char>(c.index));
+    size_t i = 0;
+    for (; i + lanes <= c.n; i += lanes) {
+        // Non empty intersection of actions
+        __mmask16 nonzero;
+        __m512i actions512;
+        __m256i actions256;
+        __m128i actions128;
+        if constexpr (sizeof(ActionSet) == 2 && lanes == 16) {
+            actions256 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions0 + i)),
+                                          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions1 + i)));
+            nonzero = _mm256_test_epi16_mask(actions256, actions256);
+        }
+        else if constexpr (sizeof(ActionSet) == 4 && lanes == 16) {
+            actions512 = _mm512_and_si512(_mm512_loadu_si512(c.actions0 + i), _mm512_loadu_si512(c.actions1 + i));
+            nonzero = _mm512_test_epi32_mask(actions512, actions512);
+        }
+        else if constexpr (sizeof(ActionSet) == 2) {
+            actions128 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions0 + i)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(c.actions1 + i)));
+            nonzero = _mm_test_epi16_mask(actions128, actions128);
+        }
+        else if constexpr (sizeof(ActionSet) == 4) {
+            actions256 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions0 + i)),
+                                          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.actions1 + i)));
+            nonzero = _mm256_test_epi32_mask(actions256, actions256);
+        }
+        else {
+            actions512 = _mm512_and_si512(_mm512_loadu_si512(c.actions0 + i), _mm512_loadu_si512(c.actions1 + i));
+            nonzero = _mm512_test_epi64_mask(actions512, actions512);
+        }
+
+        // Frequencies and gains
+        __mmask16 update;
+        if constexpr (sizeof(Counter) == 4 && lanes == 16) {
+            __m512i frequency = _mm512_add_epi32(_mm512_loadu_si512(c.frequency0 + i), _mm512_loadu_si512(c.frequency1 + i));
+            __m512i gain = _mm512_add_epi32(_mm512_loadu_si512(c.gain0 + i), _mm512_loadu_si512(c.gain1 + i));
+            gain = _mm512_mask_add_epi32(gain, nonzero, gain, frequency);
+            __m512i max_gain = _mm512_loadu_si512(c.gain + i);
+            update = _mm512_cmple_epu32_mask(max_gain, gain);
+            _mm512_storeu_si512(c.frequency + i, _mm512_mask_mov_epi32(_mm512_loadu_si512(c.frequency + i), update, frequency));
+            _mm512_storeu_si512(c.gain + i, _mm512_mask_mov_epi32(max_gain, update, gain));
+        }
+        else if constexpr (sizeof(Counter) == 4) {
+            __m256i frequency = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency0 + i)),
+                                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.frequency1 + i)));
+            __m256i gain = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain0 + i)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.gain1 + i)));
+            gain = _mm256_mask_add_epi32(gain, static_cast<__mmask8>(nonzero), gain, frequency);
+            __m256i* max_frequency = reinterpret_cast<__m256i*>(c.frequency + i);
+            __m256i* max_gain = reinterpret_cast<__m256i*>(c.gain + i);
+            __m256i max_gain_value = _mm256_loadu_si256(max_gain);
+            update = _mm256_cmple_epu32_mask(max_gain_value, gain);
+            _mm256_storeu_si256(max_frequency, _mm256_mask_mov_epi32(_mm256_loadu_si256(max_frequency), static_cast<__mmask8>(update), frequency));
+            _mm256_storeu_si256(max_gain, _mm256_mask_mov_epi32(max_gain_value, static_cast<__mmask8>(update), gain));
+        }
+        else {
+            __m512i frequency = _mm512_add_epi64(_mm512_loadu_si512(c.frequency0 + i), _mm512_loadu_si512(c.frequency1 + i));
+            __m512i gain = _mm512_add_epi64(_mm512_loadu_si512(c.gain0 + i), _mm512_loadu_si512(c.gain1 + i));
+            gain = _mm512_mask_add_epi64(gain, static_cast<__mmask8>(nonzero), gain, frequency);
+            __m512i max_gain = _mm512_loadu_si512(c.gain + i);
+            update = _mm512_cmple_epu64_mask(max_gain, gain);
+            _mm512_storeu_si512(c.frequency + i, _mm512_mask_mov_epi64(_mm512_loadu_si512(c.frequency + i), static_cast<__mmask8>(update), frequency));
+            _mm512_storeu_si512(c.gain + i, _mm512_mask_mov_epi64(max_gain, static_cast<__mmask8>(update), gain));
+        }
+
+        // Actions and index of the best condition
+        if constexpr (sizeof(ActionSet) == 2 && lanes == 16) {
+            __m256i* actions = reinterpret_cast<__m256i*>(c.actions + i);
+            _mm256_storeu_si256(actions, _mm256_mask_mov_epi16(_mm256_loadu_si256(actions), update, actions256));
+        }
+        else if constexpr (sizeof(ActionSet) == 4 && lanes == 16) {
+            _mm512_storeu_si512(c.actions + i, _mm512_mask_mov_epi32(_mm512_loadu_si512(c.actions + i), update, actions512));
+        }
+        else if constexpr (sizeof(ActionSet) == 2) {
+            __m128i* actions = reinterpret_cast<__m128i*>(c.actions + i);
+            _mm_storeu_si128(actions, _mm_mask_mov_epi16(_mm_loadu_si128(actions), static_cast<__mmask8>(update), actions128));
+        }
+        else if constexpr (sizeof(ActionSet) == 4) {
+            __m256i* actions = reinterpret_cast<__m256i*>(c.actions + i);
+            _mm256_storeu_si256(actions, _mm256_mask_mov_epi32(_mm256_loadu_si256(actions), static_cast<__mmask8>(update), actions256));
+        }
+        else {
+            _mm512_storeu_si512(c.actions + i, _mm512_mask_mov_epi64(_mm512_loadu_si512(c.actions + i), static_cast<__mmask8>(update), actions512));
+        }
+        __m128i* max_gain_index = reinterpret_cast<__m128i*>(c.max_gain_index + i);
+        if constexpr (lanes == 16) {
+            _mm_storeu_si128(max_gain_index, _mm_mask_mov_epi8(_mm_loadu_si128(max_gain_index), update, index));
+        }
+        else {
+            _mm_storel_epi64(max_gain_index, _mm_mask_mov_epi8(_mm_loadl_epi64(max_gain_index), update, index));
+        }
+    }
+    CombineTail(c, i);
+}
+
+#endif // GRAPHGEN_X86
+
+template <typename ActionSet, typename Counter>
+CombineKernel<ActionSet, Counter> GetCombineKernel(KernelIsa isa) {
+    isa = min(isa, DetectKernelIsa());
+#ifdef GRAPHGEN_X86
+    if constexpr (is_integral_v<ActionSet>) {
+        if (isa == KernelIsa::AVX512) {
+            return CombineAvx512<ActionSet, Counter>;
+        }
+        if (isa == KernelIsa::AVX2) {
+            if constexpr (sizeof(Counter) == 4 && sizeof(ActionSet) < 8) {
+                return CombineAvx2Counter32<ActionSet>;
+            }
+            else if constexpr (sizeof(Counter) == 8) {
+                return CombineAvx2Counter64<ActionSet>;
+            }
+        }
+    }
+#endif
+    return CombineCellsScalar<ActionSet, Counter>;
+}
+
+template CombineKernel<uint16_t, uint32_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<uint16_t, uint64_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<uint32_t, uint32_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<uint32_t, uint64_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<uint64_t, uint32_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<uint64_t, uint64_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<std::bitset<131>, uint32_t> GetCombineKernel(KernelIsa isa);
+template CombineKernel<std::bitset<131>, uint64_t> GetCombineKernel(KernelIsa isa);
+
+}
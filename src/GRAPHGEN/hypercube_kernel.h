@@ -0,0 +1,89 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_HYPERCUBE_KERNEL_H_
+#define GRAPHGEN_HYPERCUBE_KERNEL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hyper {
+
+/** @brief Contiguous run of hypercube cells to be combined by a combine kernel.
+
+For each cell i in [0, n) the kernel merges the two children of the cell through the
+indifference at position "index": actions are intersected, frequencies and gains are summed
+(adding the frequency to the gain when the intersection is not empty). The result replaces the
+current best of the cell (actions, frequency, gain, max_gain_index) when its gain is greater or
+equal to the current one. Since OptimizeLevel() (see hypercube_level.h) combines the indifferences
+of a cell in increasing position, ties are won by the last condition.
+*/
+template <typename ActionSet, typename Counter>
+struct CombineCells {
+    size_t n;
+
+    const ActionSet* actions0;
+    const ActionSet* actions1;
+    const Counter* frequency0;
+    const Counter* frequency1;
+    const Counter* gain0;
+    const Counter* gain1;
+    uint8_t index;
+
+    ActionSet* actions;
+    Counter* frequency;
+    Counter* gain;
+    uint8_t* max_gain_index;
+};
+
+template <typename ActionSet, typename Counter>
+using CombineKernel = void(*)(const CombineCells<ActionSet, Counter>& c);
+
+/** @brief Portable version of the combine kernel, which supports every ActionSet */
+template <typename ActionSet, typename Counter>
+inline void CombineCellsScalar(const CombineCells<ActionSet, Counter>& c) {
+    for (size_t i = 0; i < c.n; ++i) {
+        ActionSet actions = c.actions0[i] & c.actions1[i];
+        Counter frequency = c.frequency0[i] + c.frequency1[i];
+        Counter gain = c.gain0[i] + c.gain1[i];
+        if (actions != 0) {
+            gain += frequency;
+        }
+        if (c.gain[i] <= gain) {
+            c.actions[i] = actions;
+            c.frequency[i] = frequency;
+            c.gain[i] = gain;
+            c.max_gain_index[i] = c.index;
+        }
+    }
+}
+
+/** @brief Instruction sets for which a combine kernel is available */
+enum class KernelIsa {
+    SCALAR,
+    AVX2,
+    AVX512, // AVX-512 F + BW + VL
+};
+
+/** @brief Returns the name of the instruction set */
+const char* KernelIsaName(KernelIsa isa);
+
+/** @brief Returns the best instruction set supported by the running CPU */
+KernelIsa DetectKernelIsa();
+
+/** @brief Returns the combine kernel for the given instruction set.
+
+Vectorized kernels are available for integral ActionSets of 16, 32 and 64 bits combined
+with 32 and 64 bits Counters (64 bits ActionSet with 32 bits Counter only for AVX-512). For
+the other types, and when the required instruction set is not supported by the CPU, the
+scalar kernel is returned.
+*/
+template <typename ActionSet, typename Counter>
+CombineKernel<ActionSet, Counter> GetCombineKernel(KernelIsa isa = DetectKernelIsa());
+
+}
+
+#endif // !GRAPHGEN_HYPERCUBE_KERNEL_H_
@@ -0,0 +1,136 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "hypercube_level.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace hyper {
+
+LevelLayout::LevelLayout(size_t nbits) : nbits_(nbits) {
+    // Binomial coefficients, used to compute the rank of the indifference masks
+    binomial_.resize(nbits_ + 1, vector<size_t>(nbits_ + 2, 0));
+    for (size_t n = 0; n <= nbits_; ++n) {
+        binomial_[n][0] = 1;
+        for (size_t k = 1; k <= n; ++k) {
+            binomial_[n][k] = binomial_[n - 1][k - 1] + binomial_[n - 1][k];
+        }
+    }
+}
+
+size_t LevelLayout::Size() const {
+    size_t nnodes = 0;
+    for (size_t k = 0; k <= nbits_; ++k) {
+        nnodes += LevelSize(k);
+    }
+    return nnodes;
+}
+
+vector<uint32_t> LevelLayout::LevelMasks(size_t num_indif) const {
+    vector<uint32_t> masks;
+    masks.reserve(Masks(num_indif));
+    uint32_t mask = (1u << num_indif) - 1;
+    uint32_t last = mask << (nbits_ - num_indif);
+    while (true) {
+        masks.push_back(mask);
+        if (mask == last)
+            break;
+        // next permutation (https://graphics.stanford.edu/~seander/bithacks.html#NextBitPermutation)
+        uint32_t t = mask | (mask - 1);
+        mask = (t + 1) | (((~t & (0u - ~t)) - 1) >> (PopCount((mask & (0u - mask)) - 1) + 1));
+    }
+    return masks;
+}
+
+template <typename ActionSet, typename Counter>
+void OptimizeLevel(const LevelLayout& layout, size_t num_indif, LevelCells<ActionSet, Counter> prev, LevelCells<ActionSet, Counter> cur,
+                   CombineKernel<ActionSet, Counter> kernel, thread_pool* pool, size_t nthreads)
+{
+    vector<uint32_t> masks = layout.LevelMasks(num_indif);
+    size_t nbits = layout.nbits();
+    size_t value_bits = nbits - num_indif;
+    size_t value_mask = (size_t(1) << value_bits) - 1;
+    size_t level_size = layout.LevelSize(num_indif);
+
+    auto optimize_range = [&](size_t first, size_t last) {
+        // Nodes are processed one mask at a time and, for each indifference of the mask, the
+        // corresponding children are combined into all the nodes of the range
+        while (first < last) {
+            size_t mask_rank = first >> value_bits;
+            size_t mask_end = std::min(last, (mask_rank + 1) << value_bits);
+            size_t value_begin = first & value_mask;
+            size_t value_end = value_begin + (mask_end - first);
+            uint32_t mask = masks[mask_rank];
+
+            std::fill_n(cur.actions + first, mask_end - first, ActionSet(0));
+            std::fill_n(cur.max_gain_index + first, mask_end - first, uint8_t(0));
+            std::fill_n(cur.frequency + first, mask_end - first, Counter(0));
+            std::fill_n(cur.gain + first, mask_end - first, Counter(0));
+
+            for (uint8_t p = 0; p < nbits; ++p) {
+                if (((mask >> p) & 1) == 0) {
+                    continue;
+                }
+                // Position of the bit in the value of the children and offset of the children in the previous level
+                size_t s = p - PopCount(mask & ((1u << p) - 1));
+                size_t base = layout.Rank(mask & ~(1u << p)) << (value_bits + 1);
+                size_t run = size_t(1) << s;
+
+                for (size_t value = value_begin; value < value_end;) {
+                    size_t run_end = std::min(value_end, (value | (run - 1)) + 1);
+                    size_t idx0 = base + InsertBit(value, s, 0);
+                    size_t idx1 = idx0 + run;
+                    size_t n = (mask_rank << value_bits) | value;
+
+                    CombineCells<ActionSet, Counter> c{ run_end - value,
+                        prev.actions + idx0, prev.actions + idx1,
+                        prev.frequency + idx0, prev.frequency + idx1,
+                        prev.gain + idx0, prev.gain + idx1,
+                        p,
+                        cur.actions + n, cur.frequency + n, cur.gain + n, cur.max_gain_index + n };
+                    // Short runs don't fill a vector register
+                    if (c.n >= 16) {
+                        kernel(c);
+                    }
+                    else {
+                        CombineCellsScalar(c);
+                    }
+                    value = run_end;
+                }
+            }
+            first = mask_end;
+        }
+    };
+
+    size_t nchunks = std::min(level_size, nthreads * 4);
+    if (pool == nullptr || nchunks <= 1) {
+        optimize_range(0, level_size);
+        return;
+    }
+
+    vector<future<void>> chunks;
+    size_t chunk_size = (level_size + nchunks - 1) / nchunks;
+    for (size_t first = 0; first < level_size; first += chunk_size) {
+        chunks.push_back(pool->enqueue_task(optimize_range, first, std::min(first + chunk_size, level_size)));
+    }
+    // Wait for the whole level to be completed before moving to the next one
+    for (auto& c : chunks) {
+        c.get();
+    }
+}
+
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<uint16_t, uint32_t>, LevelCells<uint16_t, uint32_t>, CombineKernel<uint16_t, uint32_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<uint16_t, uint64_t>, LevelCells<uint16_t, uint64_t>, CombineKernel<uint16_t, uint64_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<uint32_t, uint32_t>, LevelCells<uint32_t, uint32_t>, CombineKernel<uint32_t, uint32_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<uint32_t, uint64_t>, LevelCells<uint32_t, uint64_t>, CombineKernel<uint32_t, uint64_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<uint64_t, uint32_t>, LevelCells<uint64_t, uint32_t>, CombineKernel<uint64_t, uint32_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<uint64_t, uint64_t>, LevelCells<uint64_t, uint64_t>, CombineKernel<uint64_t, uint64_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<std::bitset<131>, uint32_t>, LevelCells<std::bitset<131>, uint32_t>, CombineKernel<std::bitset<131>, uint32_t>, thread_pool*, size_t);
+template void OptimizeLevel(const LevelLayout&, size_t, LevelCells<std::bitset<131>, uint64_t>, LevelCells<std::bitset<131>, uint64_t>, CombineKernel<std::bitset<131>, uint64_t>, thread_pool*, size_t);
+
+}
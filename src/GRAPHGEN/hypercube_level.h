@@ -0,0 +1,103 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_HYPERCUBE_LEVEL_H_
+#define GRAPHGEN_HYPERCUBE_LEVEL_H_
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hypercube_kernel.h"
+#include "pool.h"
+
+namespace hyper {
+
+// Returns the number of bits set in x
+inline size_t PopCount(uint32_t x) {
+    return std::bitset<32>(x).count();
+}
+
+// Returns the value of a node of the next level, obtained by inserting bit b in position s
+// of the value of the current one
+inline size_t InsertBit(size_t value, size_t s, size_t b) {
+    size_t low_mask = (size_t(1) << s) - 1;
+    return (value & low_mask) | (b << s) | ((value & ~low_mask) << 1);
+}
+
+/** @brief Level-ordered layout of the nodes of an hypercube with nbits conditions.
+
+The nodes of the hypercube are grouped by level (number of indifferences). A node of level k
+is identified by the rank of its indifference mask among the masks with k indifferences (in
+increasing order) and by the value of its remaining n-k conditions, so each level is a dense
+array of C(n,k)*2^(n-k) nodes, without holes. The value of a node stores the conditions which
+are not indifferences from the least significant one, as BinaryWithIndifference() does.
+*/
+class LevelLayout {
+    size_t nbits_;
+    std::vector<std::vector<size_t>> binomial_;
+
+public:
+    LevelLayout(size_t nbits);
+
+    size_t nbits() const { return nbits_; }
+
+    /** @brief Returns the number of indifference masks of the given level */
+    size_t Masks(size_t num_indif) const { return binomial_[nbits_][num_indif]; }
+
+    /** @brief Returns the number of nodes of the given level */
+    size_t LevelSize(size_t num_indif) const { return Masks(num_indif) << (nbits_ - num_indif); }
+
+    /** @brief Returns the number of nodes of the whole hypercube */
+    size_t Size() const;
+
+    /** @brief Returns the masks of the given level in increasing order, so that their position is their rank */
+    std::vector<uint32_t> LevelMasks(size_t num_indif) const;
+
+    /** @brief Returns the rank of an indifference mask among the masks with the same number of bits set
+    (combinatorial number system) */
+    size_t Rank(uint32_t mask) const {
+        size_t rank = 0;
+        for (size_t pos = 0, i = 0; mask != 0; ++pos, mask >>= 1) {
+            if (mask & 1) {
+                rank += binomial_[pos][++i];
+            }
+        }
+        return rank;
+    }
+
+    /** @brief Returns the position of a node in its level */
+    size_t Index(size_t num_indif, uint32_t mask, size_t value) const {
+        return (Rank(mask) << (nbits_ - num_indif)) | value;
+    }
+};
+
+/** @brief Nodes of a level of the hypercube, stored as a structure of arrays */
+template <typename ActionSet, typename Counter>
+struct LevelCells {
+    ActionSet* actions;
+    uint8_t* max_gain_index;
+    Counter* frequency;
+    Counter* gain;
+};
+
+/** @brief Optimizes all the nodes of level num_indif reading the nodes of level num_indif - 1.
+
+For each indifference of a mask the children of all the nodes of the mask are combined in runs
+by kernel (see hypercube_kernel.h): inserting bit s in consecutive values gives consecutive
+children, in runs of 2^s. Indifferences are visited in increasing position and every kernel
+uses the same tie rule, so the result doesn't depend on the kernel nor on the number of threads.
+The level is split in chunks processed by pool; when pool is nullptr it is optimized by the
+calling thread.
+*/
+template <typename ActionSet, typename Counter>
+void OptimizeLevel(const LevelLayout& layout, size_t num_indif, LevelCells<ActionSet, Counter> prev, LevelCells<ActionSet, Counter> cur,
+                   CombineKernel<ActionSet, Counter> kernel, thread_pool* pool, size_t nthreads);
+
+}
+
+#endif // !GRAPHGEN_HYPERCUBE_LEVEL_H_
@@ -10,10 +10,22 @@
 #include <limits>
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
+#include "frequency_table.h"
 #include "utilities.h"
 #include "performance_evaluator.h"
+#include "queue.h"
 
 using namespace std;
 using namespace filesystem;
@@ -38,18 +50,84 @@ mask::mask(const rule_set& rs) : rs_{ rs } {
     for (int i = 0; i < exp_; ++i) {
         mask_(ps.pixels_[i].GetDy() + top_, ps.pixels_[i].GetDx() + left_) = 1;
     }
+
+    for (const auto& p : ps) {
+        pixels_.push_back({ p.GetDx(), p.GetDy(), rs_.conditions_pos.at(p.name_) });
+    }
+
+    if (mask_.rows <= kMaxColumnHeight) {
+        column_rules_.resize(mask_.cols, vector<size_t>(size_t(1) << mask_.rows, 0));
+        for (const auto& p : pixels_) {
+            auto& rules = column_rules_[p.dx + left_];
+            for (size_t code = 0; code < rules.size(); ++code) {
+                if ((code >> (p.dy + top_)) & 1) {
+                    rules[code] |= size_t(1) << p.bit;
+                }
+            }
+        }
+    }
 }
 
 size_t mask::MaskToLinearMask(const cv::Mat1b& r_img) const {
     size_t linearMask = 0;
 
-	for (const auto& p : rs_.ps_) {
-		linearMask |= r_img(p.GetDy() + top_, p.GetDx() + left_) << rs_.conditions_pos.at(p.name_);
-	}
+    for (const auto& p : pixels_) {
+        linearMask |= size_t(r_img(p.dy + top_, p.dx + left_)) << p.bit;
+    }
 
     return linearMask;
 }
 
+template <typename Histogram>
+void mask::CountRules(const cv::Mat1b& img, Histogram& freqs) const {
+    if (column_rules_.empty()) {
+        // Masks too tall for the column codes read every pixel of every position
+        cv::Mat1b clone;
+        copyMakeBorder(img, clone, border_, border_, border_, border_, cv::BORDER_CONSTANT, 0);
+        for (int r = 0; r < img.rows; r += increment_) {
+            for (int c = 0; c < img.cols; c += increment_) {
+                size_t rule = MaskToLinearMask(clone(cv::Rect(cv::Point(c + border_ - left_, r + border_ - top_), cv::Point(c + border_ + 1 + right_, r + border_ + 1 + bottom_))));
+                if (++freqs[rule] == numeric_limits<unsigned long long>::max()) {
+                    cout << "OVERFLOW freq\n";
+                }
+            }
+        }
+        return;
+    }
+
+    const int height = mask_.rows, width = mask_.cols;
+    // Column codes of the image, with the columns of the border (which are always 0) on both sides
+    vector<uint32_t> codes(img.cols + left_ + right_);
+    for (int r = 0; r < img.rows; r += increment_) {
+        fill(begin(codes), end(codes), 0);
+        uint32_t* row_codes = codes.data() + left_;
+        for (int k = 0; k < height; ++k) {
+            int y = r - top_ + k;
+            if (y < 0 || y >= img.rows) {
+                continue;
+            }
+            const uchar* row = img.ptr<uchar>(y);
+            // Simple enough to be vectorized by the compiler
+            for (int c = 0; c < img.cols; ++c) {
+                row_codes[c] |= uint32_t(row[c] != 0) << k;
+            }
+        }
+
+        for (int c = 0; c < img.cols; c += increment_) {
+            size_t rule = 0;
+            for (int x = 0; x < width; ++x) {
+                rule |= column_rules_[x][codes[c + x]];
+            }
+            if (++freqs[rule] == numeric_limits<unsigned long long>::max()) {
+                cout << "OVERFLOW freq\n";
+            }
+        }
+    }
+}
+
+template void mask::CountRules(const cv::Mat1b& img, vector<unsigned long long>& freqs) const;
+template void mask::CountRules(const cv::Mat1b& img, unordered_map<uint64_t, unsigned long long>& freqs) const;
+
 // This function extracts all the configurations of a given mask (mask) in a given image (img) and stores the occurrences (frequencies) in the rRules vector
 //void CalculateConfigurationsFrequencyOnImage(const cv::Mat1b& img, const mask& msk, rule_set& rs) {
 //
@@ -73,39 +151,88 @@ size_t mask::MaskToLinearMask(const cv::Mat1b& r_img) const {
 
 // Overloaded function that accepts a vector instead of a ruleset
 void CalculateConfigurationsFrequencyOnImage(const cv::Mat1b& img, const mask& msk, vector<unsigned long long>& freqs) {
+    msk.CountRules(img, freqs);
+}
 
-    cv::Mat1b clone;
-    copyMakeBorder(img, clone, msk.border_, msk.border_, msk.border_, msk.border_, cv::BORDER_CONSTANT, 0);
-    const int h = clone.rows, w = clone.cols;
-
-    for (int r = msk.border_; r < h - msk.border_; r += msk.increment_) {
-
-        for (int c = msk.border_; c < w - msk.border_; c += msk.increment_) {
+bool GetBinaryImage(const string& FileName, cv::Mat1b& binary) {
+    vector<uchar> buffer;
+    return GetBinaryImage(FileName, binary, buffer);
+}
 
-            const cv::Mat1b read_pixels = clone(cv::Rect(cv::Point(c - msk.left_, r - msk.top_), cv::Point(c + 1 + msk.right_, r + 1 + msk.bottom_)));
-            size_t rule = msk.MaskToLinearMask(read_pixels);
-            freqs[rule]++;
-            if (freqs[rule] == numeric_limits<unsigned long long>::max()) {
-                cout << "OVERFLOW freq\n";
+// Reads a binary PBM (P4) image, whose pixels are packed 8 per byte (1 meaning black), with the values that the
+// thresholding of its decoded version would give: 1 for white pixels and 0 for black ones
+static bool ReadPackedBitmap(const vector<uchar>& file, cv::Mat1b& binary) {
+    size_t pos = 2;
+    auto ReadNumber = [&](int& n) {
+        // Whitespaces and comments may precede each number of the header
+        while (pos < file.size() && (isspace(file[pos]) || file[pos] == '#')) {
+            if (file[pos] == '#') {
+                while (pos < file.size() && file[pos] != '\n') {
+                    ++pos;
+                }
             }
+            else {
+                ++pos;
+            }
+        }
+        if (pos == file.size() || !isdigit(file[pos])) {
+            return false;
         }
+        for (n = 0; pos < file.size() && isdigit(file[pos]); ++pos) {
+            n = n * 10 + (file[pos] - '0');
+        }
+        return true;
+    };
+    int w, h;
+    if (!ReadNumber(w) || !ReadNumber(h) || w <= 0 || h <= 0) {
+        return false;
     }
+    ++pos; // Single whitespace before the pixels
+    size_t row_bytes = (static_cast<size_t>(w) + 7) / 8;
+    if (file.size() < pos + row_bytes * h) {
+        return false;
+    }
+
+    binary.create(h, w);
+    for (int r = 0; r < h; ++r) {
+        const uchar* packed = file.data() + pos + r * row_bytes;
+        uchar* row = binary.ptr<uchar>(r);
+        for (int c = 0; c < w; ++c) {
+            row[c] = ((packed[c / 8] >> (7 - c % 8)) & 1) ^ 1;
+        }
+    }
+    return true;
 }
 
-bool GetBinaryImage(const string& FileName, cv::Mat1b& binary) {
-    // Image load
-    cv::Mat image;
-    image = cv::imread(FileName, cv::IMREAD_GRAYSCALE);   // Read the file
+// Reads the whole content of a file into buffer
+static bool ReadFile(const string& FileName, vector<uchar>& buffer) {
+    ifstream is(FileName, ios::binary | ios::ate);
+    if (!is) {
+        return false;
+    }
+    auto size = static_cast<size_t>(is.tellg());
+    is.seekg(0);
+    buffer.resize(size);
+    return static_cast<bool>(is.read(reinterpret_cast<char*>(buffer.data()), size));
+}
 
-    if (image.empty()) // Check if image exists
+bool GetBinaryImage(const string& FileName, cv::Mat1b& binary, vector<uchar>& buffer) {
+    if (!ReadFile(FileName, buffer)) {
         return false;
+    }
 
-    //// Convert the image to grayscale
-    //Mat grayscaleMat;
-    //cvtColor(image, grayscaleMat, CV_RGB2GRAY);
+    // Pre-binarized images are not decoded at all
+    if (buffer.size() >= 2 && buffer[0] == 'P' && buffer[1] == '4') {
+        return ReadPackedBitmap(buffer, binary);
+    }
 
-    // Adjust the threshold to actually make it binary
-    cv::threshold(image, binary, 100, 1, cv::THRESH_BINARY);
+    // The image is decoded directly into binary, whose memory is reused when it has the right size, and
+    // then thresholded in place to actually make it binary
+    cv::imdecode(buffer, cv::IMREAD_GRAYSCALE, &binary);
+    if (binary.empty()) {
+        return false;
+    }
+    cv::threshold(binary, binary, 100, 1, cv::THRESH_BINARY);
 
     return true;
 }
@@ -172,75 +299,315 @@ bool LoadFileList(vector<pair<string, bool>>& filenames, const string& files_pat
 //}
 
 
-bool CountFrequenciesOnDataset(const string& dataset, rule_set& rs, bool force) {
+static path FrequenciesPath(const string& dataset) {
+    return conf.frequencies_path_ / conf.mask_name_ / (dataset + conf.frequencies_suffix_);
+}
 
-    path frequencies_output_path = conf.frequencies_path_ / conf.mask_name_ / (dataset + conf.frequencies_suffix_);
+static void StoreFrequencies(const string& dataset, const FrequencyTable& freqs, const rule_set& rs) {
+    if (!freqs.Store(FrequenciesPath(dataset), conf.mask_name_, rs)) {
+        cerr << "Frequencies of " << dataset << " couldn't be stored into file.\n";
+    }
+}
 
-    if (!force) {
-        // Try to load frequencies from file
-        ifstream is;
-        is.exceptions(fstream::badbit | fstream::failbit | fstream::eofbit);
+// Adds to rs the frequencies of a dataset stored into file, if they are available. Files in the dense format of
+// older versions are converted to the sparse one
+static bool LoadFrequencies(const string& dataset, rule_set& rs) {
+    FrequencyTable freqs;
+    bool legacy;
+    if (!freqs.Load(FrequenciesPath(dataset), conf.mask_name_, rs, legacy)) {
+        cout << "Frequencies of " << dataset << " couldn't be loaded from file.\n";
+        return false;
+    }
+    freqs.AddTo(rs);
+    cout << "Frequencies of " << dataset << " were loaded from file.\n";
+    if (legacy) {
+        StoreFrequencies(dataset, freqs, rs);
+    }
+    return true;
+}
 
-        try {
-            is.open(frequencies_output_path, ios::binary);
-            vector<rule> new_rules = rs.rules;
-            std::for_each(new_rules.begin(), new_rules.end(), [&is](rule& r) { 
-				unsigned long long v;
-				is.read(reinterpret_cast<char*>(&v), 8);
-				r.frequency += v;
-			});
-            rs.rules = new_rules;
-            cout << "Frequencies of " << dataset << " were loaded from file.\n";
-            return true;
-        }
-        catch (const ifstream::failure&) {
-            cout << "Frequencies of " << dataset << " couldn't be loaded from file.\n";
-        }
-        catch (const runtime_error&) {
-            cout << "Frequencies of " << dataset << " couldn't be loaded from file.\n";
-        }
+// An image which contributed to the frequencies of a dataset. Its size, modification time and the hash of its
+// content tell whether it has been modified since its frequencies were counted
+struct FileRecord {
+    string name_;
+    uintmax_t size_ = 0;
+    long long mtime_ = 0;
+    uint64_t hash_ = 0;
+};
+
+static path FileRecordsPath(const string& dataset) {
+    return conf.frequencies_path_ / conf.mask_name_ / (dataset + conf.frequencies_files_suffix_);
+}
+
+// FNV-1a hash of the content of a file
+static uint64_t HashContent(const vector<uchar>& content) {
+    uint64_t h = 14695981039346656037ull;
+    for (uchar c : content) {
+        h = (h ^ c) * 1099511628211ull;
     }
+    return h;
+}
 
-    mask msk(rs);
+static long long ModificationTime(const path& p) {
+    error_code ec;
+    auto t = last_write_time(p, ec);
+    return ec ? 0 : static_cast<long long>(t.time_since_epoch().count());
+}
 
-    cv::Mat1b img;
+// The images which contributed to the frequencies of a dataset are stored one per line, as size, modification
+// time, hash and name, after a header with the version of the format
+static void StoreFileRecords(const string& dataset, const vector<FileRecord>& records) {
+    ofstream os(FileRecordsPath(dataset));
+    if (!os) {
+        cerr << "Images counted in " << dataset << " couldn't be stored into file.\n";
+        return;
+    }
+    os << "GGFILES 1\n";
+    for (const auto& r : records) {
+        os << r.size_ << ' ' << r.mtime_ << ' ' << r.hash_ << ' ' << r.name_ << '\n';
+    }
+}
 
-    path dataset_path = conf.global_input_path_ / path(dataset);
-    vector<pair<string, bool>> files_list;
-    if (!LoadFileList(files_list, (dataset_path / path("files.txt")).string())) {
-        cout << "Unable to find 'files.txt' of " << dataset_path << ", dataset skipped.\n";
+static bool LoadFileRecords(const string& dataset, vector<FileRecord>& records) {
+    ifstream is(FileRecordsPath(dataset));
+    string header;
+    if (!getline(is, header) || header != "GGFILES 1") {
         return false;
     }
-    cout << dataset << ":\n";
+    FileRecord r;
+    while (is >> r.size_ >> r.mtime_ >> r.hash_) {
+        is.get(); // Separator before the name, which may contain spaces
+        if (!getline(is, r.name_)) {
+            return false;
+        }
+        records.push_back(r);
+    }
+    return is.eof();
+}
 
-    vector<unsigned long long> freqs(rs.rules.size(), 0);
+// A dataset whose frequencies are counted by CountFrequenciesOnDatasets
+struct DatasetCount {
+    string name_;
+    path path_;
+    vector<pair<string, bool>> files_;
+    FrequencyTable freqs_;
+    vector<size_t> missing_;    // Files which couldn't be loaded
+    mutex m_;                   // Protects freqs_ and missing_
+    vector<FileRecord> records_;    // Files counted, by position in files_ (without name if they couldn't be loaded)
+    vector<FileRecord> counted_;    // Files already counted in freqs_ before CountFrequenciesOnDatasets
+};
+
+// Prepares the incremental count of a dataset whose frequencies are stored into file, setting its freqs_ and counted_
+// to the stored frequencies and images and its files_ to the images added since then. Returns false if the dataset
+// must be counted from scratch, because what was counted is unknown or images have been modified or removed
+static bool PrepareIncrementalCount(DatasetCount& ds, const rule_set& rs) {
+    bool legacy;
+    if (!ds.freqs_.Load(FrequenciesPath(ds.name_), conf.mask_name_, rs, legacy)) {
+        cout << "Frequencies of " << ds.name_ << " couldn't be loaded from file.\n";
+        return false;
+    }
+    vector<FileRecord> records;
+    if (!LoadFileRecords(ds.name_, records)) {
+        cout << "Images counted in " << ds.name_ << " are unknown, frequencies will be counted from scratch.\n";
+        ds.freqs_ = FrequencyTable();
+        return false;
+    }
 
-    size_t files_list_size = files_list.size();
-    for (size_t d = 0; d < files_list_size; ++d) {
-        cout << '\r' << d << '/' << files_list_size;
-        path file_name = files_list[d].first;
-        GetBinaryImage((dataset_path / file_name).string(), img);
-        if (img.empty()) {
-            cout << "Unable to find '" << file_name << "' image in '" << dataset_path << "' dataset, image skipped\n";
+    unordered_map<string, size_t> recorded;
+    for (size_t i = 0; i < records.size(); ++i) {
+        recorded[records[i].name_] = i;
+    }
+    vector<pair<string, bool>> added;
+    vector<uchar> buffer;
+    size_t found = 0;
+    bool touched = false;
+    for (const auto& f : ds.files_) {
+        auto it = recorded.find(f.first);
+        if (it == recorded.end()) {
+            added.push_back(f);
             continue;
         }
-        CalculateConfigurationsFrequencyOnImage(img, msk, freqs);
+        ++found;
+        auto& r = records[it->second];
+        path p = ds.path_ / path(f.first);
+        error_code ec;
+        bool modified = file_size(p, ec) != r.size_ || ec;
+        if (!modified) {
+            long long mtime = ModificationTime(p);
+            if (mtime != r.mtime_) {
+                // Images which were just touched or copied are modified only if their content changed
+                modified = !ReadFile(p.string(), buffer) || HashContent(buffer) != r.hash_;
+                r.mtime_ = mtime;
+                touched = true;
+            }
+        }
+        if (modified) {
+            cout << "'" << f.first << "' image of " << ds.name_ << " was modified, frequencies will be counted from scratch.\n";
+            ds.freqs_ = FrequencyTable();
+            return false;
+        }
+    }
+    if (found != records.size()) {
+        cout << "Images counted in " << ds.name_ << " were removed, frequencies will be counted from scratch.\n";
+        ds.freqs_ = FrequencyTable();
+        return false;
+    }
+
+    if (touched) {
+        // Not to hash them again next time
+        StoreFileRecords(ds.name_, records);
     }
-    cout << '\r' << files_list_size << '/' << files_list_size << '\n';
+    ds.files_ = move(added);
+    ds.counted_ = move(records);
+    return true;
+}
 
-    for_each(freqs.begin(), freqs.end(), [rs_it = rs.rules.begin()](unsigned long long f) mutable { (*rs_it++).frequency += f; });
+// Rule sets with up to this number of rules are counted on dense histograms (8 bytes for each rule, 8 MiB at most)
+static constexpr size_t kMaxDenseRules = size_t(1) << 20;
 
-    ofstream os(frequencies_output_path, ios::binary);
-    if (!os) {
-        cerr << "Frequencies of " << dataset << " couldn't be stored into file.\n";
+// Returns the table of the counts of a histogram of a counter, which is then cleared
+static FrequencyTable TakeCounts(vector<unsigned long long>& freqs) {
+    FrequencyTable t = FrequencyTable::FromDense(freqs);
+    fill(begin(freqs), end(freqs), 0);
+    return t;
+}
+static FrequencyTable TakeCounts(unordered_map<uint64_t, unsigned long long>& freqs) {
+    FrequencyTable t = FrequencyTable::FromSparse(freqs);
+    freqs.clear();
+    return t;
+}
+
+// Counts the frequencies of the rules on all the images of the given datasets. Images are loaded by the reader
+// threads and counted by the counter threads (frequencies readers and counters in the configuration), each of
+// them adding to a histogram of its own whose counts are added to the sparse table of the dataset when the
+// dataset changes. The stream of images doesn't stop between datasets, so that different datasets are processed
+// concurrently. Histograms are dense when the rules are at most kMaxDenseRules, so that they are cheap to update
+// and to scan, and sparse otherwise: most of the rules of large masks never occur, so a dense histogram would
+// take 8 bytes for each of them and for each counter, and would be scanned whole for every dataset.
+static void CountFrequenciesOnDatasets(vector<unique_ptr<DatasetCount>>& datasets, const mask& msk, size_t nrules) {
+    size_t nreaders = conf.frequencies_readers_;
+    if (nreaders == 0) {
+        nreaders = max(thread::hardware_concurrency(), 1u);
     }
-    else {
-        for_each(freqs.begin(), freqs.end(), [&os](unsigned long long f) { os.write(reinterpret_cast<const char*>(&f), 8); });
+    size_t ncounters = conf.frequencies_counters_;
+    if (ncounters == 0) {
+        ncounters = max(thread::hardware_concurrency(), 1u);
     }
 
-    return true;
-}
+    // Images of all the datasets, as (dataset, file) pairs
+    vector<pair<size_t, size_t>> images;
+    for (size_t d = 0; d < datasets.size(); ++d) {
+        datasets[d]->records_.assign(datasets[d]->files_.size(), FileRecord());
+        for (size_t f = 0; f < datasets[d]->files_.size(); ++f) {
+            images.emplace_back(d, f);
+        }
+    }
 
+    struct Image {
+        size_t dataset = numeric_limits<size_t>::max(); // Readers signal their end to counters with an invalid dataset
+        size_t file = 0;
+        cv::Mat1b img;
+    };
+    unsigned queue_size = static_cast<unsigned>(2 * (nreaders + ncounters));
+    blocking_queue<Image> queue(queue_size);
+    atomic<size_t> next_image = 0;
+    atomic<size_t> processed = 0;
+
+    // Images are decoded into a fixed set of buffers, enough for the queue and for all the threads, which counters
+    // give back to readers. Since images of a dataset usually have the same size, buffers are rarely reallocated,
+    // and the memory doesn't depend on the number of images
+    blocking_queue<cv::Mat1b> buffers(queue_size + static_cast<unsigned>(nreaders + ncounters));
+    for (unsigned i = 0; i < buffers.max_size(); ++i) {
+        buffers.push(cv::Mat1b());
+    }
+
+    auto reader = [&]() {
+        vector<uchar> file; // Content of the current file, reused as well
+        for (size_t i; (i = next_image++) < images.size(); ) {
+            auto& ds = *datasets[images[i].first];
+            Image image{ images[i].first, images[i].second, buffers.pop() };
+            const string& name = ds.files_[image.file].first;
+            path file_path = ds.path_ / path(name);
+            if (!GetBinaryImage(file_path.string(), image.img, file)) {
+                buffers.push(move(image.img));
+                lock_guard<mutex> lock(ds.m_);
+                ds.missing_.push_back(image.file);
+                ++processed;
+                continue;
+            }
+            // Each file has its own record, so no lock is required
+            ds.records_[image.file] = { name, file.size(), ModificationTime(file_path), HashContent(file) };
+            queue.push(move(image));
+        }
+    };
+
+    auto counter = [&](auto freqs) {
+        size_t cur = numeric_limits<size_t>::max();
+        auto flush = [&]() {
+            if (cur != numeric_limits<size_t>::max()) {
+                auto& ds = *datasets[cur];
+                FrequencyTable t = TakeCounts(freqs);
+                lock_guard<mutex> lock(ds.m_);
+                ds.freqs_.Add(t);
+            }
+        };
+        while (true) {
+            Image image = queue.pop();
+            if (image.dataset != cur) {
+                flush();
+                cur = image.dataset;
+            }
+            if (image.dataset == numeric_limits<size_t>::max()) {
+                break;
+            }
+            msk.CountRules(image.img, freqs);
+            buffers.push(move(image.img));
+            ++processed;
+        }
+    };
+
+    vector<thread> counters;
+    for (size_t i = 0; i < ncounters; ++i) {
+        if (nrules <= kMaxDenseRules) {
+            counters.emplace_back(counter, vector<unsigned long long>(nrules, 0));
+        }
+        else {
+            counters.emplace_back(counter, unordered_map<uint64_t, unsigned long long>());
+        }
+    }
+    vector<thread> readers;
+    for (size_t i = 0; i < nreaders; ++i) {
+        readers.emplace_back(reader);
+    }
+
+    bool done = false;
+    mutex m;
+    condition_variable finished;
+    thread progress([&]() {
+        auto start = chrono::steady_clock::now();
+        unique_lock<mutex> lock(m);
+        while (!finished.wait_for(lock, chrono::milliseconds(500), [&] { return done; })) {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << '\r' << processed << '/' << images.size() << " images (" << static_cast<size_t>(processed / seconds) << " images/s)" << flush;
+        }
+    });
+
+    for (auto& t : readers) {
+        t.join();
+    }
+    for (size_t i = 0; i < ncounters; ++i) {
+        queue.push(Image{});
+    }
+    for (auto& t : counters) {
+        t.join();
+    }
+    {
+        lock_guard<mutex> lock(m);
+        done = true;
+    }
+    finished.notify_one();
+    progress.join();
+}
 
 //void CalculateRulesFrequencies(const pixel_set& ps, const vector<string>& paths, rule_set& rs) {
 //    vector<path> datasets_path(paths.size());
@@ -348,8 +715,78 @@ bool AddFrequenciesToRuleset(rule_set& rs, bool force, bool is_thinning) {
 
     int n = 0;
 
+    // Datasets whose frequencies are not stored into file, and the images added to datasets in incremental mode,
+    // are counted together
+    vector<unique_ptr<DatasetCount>> datasets;
     for (const string& dataset : conf.datasets_) {
-        n += CountFrequenciesOnDataset(dataset, rs, force);
+        auto ds = make_unique<DatasetCount>();
+        ds->name_ = dataset;
+        ds->path_ = conf.global_input_path_ / path(dataset);
+        bool listed = LoadFileList(ds->files_, (ds->path_ / path("files.txt")).string());
+        if (!force) {
+            if (conf.frequencies_incremental_ && listed) {
+                if (PrepareIncrementalCount(*ds, rs)) {
+                    cout << "Frequencies of " << dataset << " were loaded from file, " << ds->files_.size() << " images were added.\n";
+                    if (ds->files_.empty()) {
+                        ds->freqs_.AddTo(rs);
+                        ++n;
+                        continue;
+                    }
+                }
+            }
+            else if (LoadFrequencies(dataset, rs)) {
+                ++n;
+                continue;
+            }
+        }
+        if (!listed) {
+            cout << "Unable to find 'files.txt' of " << ds->path_ << ", dataset skipped.\n";
+            continue;
+        }
+        datasets.push_back(move(ds));
+    }
+
+    if (!datasets.empty()) {
+        cout << "Counting frequencies on";
+        for (const auto& ds : datasets) {
+            cout << " " << ds->name_;
+        }
+        cout << ":\n";
+
+        PerformanceEvaluator perf;
+        perf.start();
+        mask msk(rs);
+        CountFrequenciesOnDatasets(datasets, msk, rs.rules.size());
+        double ms = perf.stop();
+
+        size_t images = 0;
+        for (const auto& ds : datasets) {
+            images += ds->files_.size();
+        }
+        cout << '\r' << images << '/' << images << " images in " << ms << " ms";
+        if (ms > 0) {
+            cout << " (" << static_cast<size_t>(images / (ms / 1000)) << " images/s)";
+        }
+        cout << "\n";
+
+        for (auto& ds : datasets) {
+            sort(begin(ds->missing_), end(ds->missing_));
+            for (size_t f : ds->missing_) {
+                cout << "Unable to find '" << ds->files_[f].first << "' image in '" << ds->path_ << "' dataset, image skipped\n";
+            }
+        }
+
+        for (const auto& ds : datasets) {
+            ds->freqs_.AddTo(rs);
+            StoreFrequencies(ds->name_, ds->freqs_, rs);
+            for (auto& r : ds->records_) {
+                if (!r.name_.empty()) {
+                    ds->counted_.push_back(move(r));
+                }
+            }
+            StoreFileRecords(ds->name_, ds->counted_);
+            ++n;
+        }
     }
 
 	if (is_thinning) {
@@ -362,4 +799,4 @@ bool AddFrequenciesToRuleset(rule_set& rs, bool force, bool is_thinning) {
 
     return n > 0;
 
-}
\ No newline at end of file
+}
@@ -8,6 +8,8 @@
 #define GRAPHGEN_IMAGE_FREQUENCIES_H_
 
 #include <filesystem>
+#include <unordered_map>
+#include <vector>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgcodecs.hpp>
@@ -24,12 +26,39 @@ struct mask {
     int increment_ = 0;
 	const rule_set& rs_;
 
+    // Offsets of the pixels of the mask and position of their conditions in the rule index, computed once
+    struct mask_pixel {
+        int dx, dy;
+        size_t bit;
+    };
+    std::vector<mask_pixel> pixels_;
+
+    // The pixels of each column of the mask, from top to bottom, are packed into the bits of a column code.
+    // column_rules_[x][code] stores the bits of the rule index set by column x when its pixels are code, so
+    // that the rule of a mask position is the OR of one lookup for each column.
+    static constexpr int kMaxColumnHeight = 16;
+    std::vector<std::vector<size_t>> column_rules_;
+
 	mask(const rule_set& rs);
     size_t MaskToLinearMask(const cv::Mat1b& r_img) const;
+
+    /** @brief Counts the occurrences of the rules in a binary image, adding them to freqs.
+
+    Each row of mask positions packs the rows of the image it reads into column codes (one for each column
+    of the image), then every position is the OR of the column_rules_ of its columns. Pixels outside the
+    image are 0. freqs is either a dense histogram, with one count for each rule, or a sparse one, which
+    only stores the rules which occur (std::unordered_map<uint64_t, unsigned long long>).
+    */
+    template <typename Histogram>
+    void CountRules(const cv::Mat1b& img, Histogram& freqs) const;
 };
 
 //void CalculateConfigurationsFrequencyOnImage(const cv::Mat1b& img, const mask &msk, rule_set &rs);
 bool GetBinaryImage(const std::string &FileName, cv::Mat1b& binary);
+/** @brief Same as GetBinaryImage(FileName, binary), without allocating memory when binary already has the size of
+the image and buffer (which stores the content of the file) is large enough, so that both can be reused to read a
+sequence of images. Binary PBM (P4) files, whose pixels are already binary, are read directly without decoding. */
+bool GetBinaryImage(const std::string &FileName, cv::Mat1b& binary, std::vector<uchar>& buffer);
 bool LoadFileList(std::vector<std::pair<std::string, bool>>& filenames, const std::string& files_path);
 //bool CalculateRulesFrequencies(const pixel_set& ps, std::vector<std::pair<std::filesystem::path, bool>>& paths, rule_set& rs);
 //void CalculateRulesFrequencies(const pixel_set &ps, const std::vector<std::string> &paths, rule_set &rs);
@@ -0,0 +1,155 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "system_info.h"
+
+#if defined(GRAPHGEN_WINDOWS)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static void ThrowError(const string& what, const filesystem::path& path) {
+    throw runtime_error("MappedFile: " + what + " '" + path.string() + "' failed.");
+}
+
+MappedFile::MappedFile(const filesystem::path& path, size_t size) : path_{ path }, size_{ size } {
+#if defined(GRAPHGEN_WINDOWS)
+    file_ = CreateFileW(path_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        ThrowError("creation of", path_);
+    }
+#else
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd_ == -1) {
+        ThrowError("creation of", path_);
+    }
+#endif
+    Resize(size);
+}
+
+MappedFile::MappedFile(const filesystem::path& path) : path_{ path }, keep_{ true }, read_only_{ true } {
+    error_code ec;
+    size_ = static_cast<size_t>(filesystem::file_size(path_, ec));
+    if (ec) {
+        ThrowError("opening of", path_);
+    }
+#if defined(GRAPHGEN_WINDOWS)
+    file_ = CreateFileW(path_.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        ThrowError("opening of", path_);
+    }
+#else
+    fd_ = open(path_.c_str(), O_RDONLY);
+    if (fd_ == -1) {
+        ThrowError("opening of", path_);
+    }
+#endif
+    Map();
+}
+
+MappedFile::~MappedFile() {
+    Close();
+    if (!keep_ && !path_.empty()) {
+        error_code ec;
+        filesystem::remove(path_, ec);
+    }
+}
+
+void MappedFile::Map() {
+    if (size_ == 0) {
+        return;
+    }
+#if defined(GRAPHGEN_WINDOWS)
+    ULARGE_INTEGER s;
+    s.QuadPart = size_;
+    mapping_ = CreateFileMappingW(file_, nullptr, read_only_ ? PAGE_READONLY : PAGE_READWRITE, s.HighPart, s.LowPart, nullptr);
+    if (mapping_ == nullptr) {
+        ThrowError("mapping of", path_);
+    }
+    data_ = static_cast<char*>(MapViewOfFile(mapping_, read_only_ ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, size_));
+    if (data_ == nullptr) {
+        ThrowError("mapping of", path_);
+    }
+#else
+    void* p = mmap(nullptr, size_, read_only_ ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        ThrowError("mapping of", path_);
+    }
+    data_ = static_cast<char*>(p);
+#endif
+}
+
+void MappedFile::Unmap() {
+#if defined(GRAPHGEN_WINDOWS)
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr) {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+#else
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+#endif
+    data_ = nullptr;
+}
+
+void MappedFile::Close() {
+    Unmap();
+#if defined(GRAPHGEN_WINDOWS)
+    if (file_ != nullptr) {
+        CloseHandle(file_);
+        file_ = nullptr;
+    }
+#else
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+void MappedFile::Resize(size_t size) {
+    if (read_only_) {
+        ThrowError("resize of read-only", path_);
+    }
+    Unmap();
+    size_ = size;
+#if defined(GRAPHGEN_WINDOWS)
+    LARGE_INTEGER s;
+    s.QuadPart = size_;
+    if (!SetFilePointerEx(file_, s, nullptr, FILE_BEGIN) || !SetEndOfFile(file_)) {
+        ThrowError("resize of", path_);
+    }
+#else
+    if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+        ThrowError("resize of", path_);
+    }
+#endif
+    Map();
+}
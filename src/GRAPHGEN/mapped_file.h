@@ -0,0 +1,95 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_MAPPED_FILE_H_
+#define GRAPHGEN_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <filesystem>
+
+/** @brief Read/write memory mapping of a file.
+
+The class allows to store data structures which do not fit in RAM: the mapped memory is
+backed by the file, so the operating system can move it back and forth from the disk when
+required. The file is created (or truncated) when the object is built and it is deleted
+when the object is destroyed, unless Keep() is called. Existing files can also be mapped
+in read-only mode, in this case they are never deleted. Errors are reported throwing a
+std::runtime_error.
+*/
+class MappedFile {
+    std::filesystem::path path_;
+    size_t size_ = 0;
+    char* data_ = nullptr;
+    bool keep_ = false;
+    bool read_only_ = false;
+#if defined(_WIN32) || defined(_WIN64)
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+    void Map();
+    void Unmap();
+    void Close();
+
+public:
+    MappedFile() {}
+
+    /** @brief Creates the file of the specified size (in bytes) and maps it in memory */
+    MappedFile(const std::filesystem::path& path, size_t size);
+
+    /** @brief Maps in memory an existing file in read-only mode. The mapped memory must not be written */
+    explicit MappedFile(const std::filesystem::path& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { swap(*this, other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        swap(*this, other);
+        return *this;
+    }
+
+    ~MappedFile();
+
+    friend void swap(MappedFile& a, MappedFile& b) noexcept {
+        using std::swap;
+        swap(a.path_, b.path_);
+        swap(a.size_, b.size_);
+        swap(a.data_, b.data_);
+        swap(a.keep_, b.keep_);
+        swap(a.read_only_, b.read_only_);
+#if defined(_WIN32) || defined(_WIN64)
+        swap(a.file_, b.file_);
+        swap(a.mapping_, b.mapping_);
+#else
+        swap(a.fd_, b.fd_);
+#endif
+    }
+
+    /** @brief Changes the size of the file and remaps it. The first min(size(), size) bytes are preserved,
+    but the address of the mapping may change. */
+    void Resize(size_t size);
+
+    /** @brief Prevents the file from being deleted when the object is destroyed */
+    void Keep() { keep_ = true; }
+
+    bool read_only() const { return read_only_; }
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::filesystem::path& path() const { return path_; }
+
+    /** @brief Returns a pointer of type T to the specified offset (in bytes) of the mapping */
+    template <typename T>
+    T* as(size_t offset = 0) { return reinterpret_cast<T*>(data_ + offset); }
+    template <typename T>
+    const T* as(size_t offset = 0) const { return reinterpret_cast<const T*>(data_ + offset); }
+};
+
+#endif // !GRAPHGEN_MAPPED_FILE_H_
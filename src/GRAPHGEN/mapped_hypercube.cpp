@@ -0,0 +1,112 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "mapped_hypercube.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "hypercube++.h"
+#include "hypercube_kernel.h"
+#include "performance_evaluator.h"
+
+using namespace std;
+
+namespace hyper {
+
+template <typename ActionSet, typename Counter>
+MappedHyperCube<ActionSet, Counter>::MappedHyperCube(const rule_set& rs, const filesystem::path& directory)
+    : nbits_(rs.conditions.size()), rs_(rs), directory_(directory), layout_(rs.conditions.size())
+{
+    filesystem::create_directories(directory_);
+    levels_.reserve(nbits_ + 1);
+    CreateLevel(0);
+
+    // Level 0 has no indifferences, so the value of its nodes is the rule index
+    Level& l = levels_[0];
+    auto nrules = rs.rules.size();
+    for (size_t i = 0; i < nrules; ++i) {
+        l.actions()[i] = ToActionSet<ActionSet>(rs.rules[i].actions);
+        l.max_gain_index()[i] = 0;
+        l.frequency()[i] = static_cast<Counter>(rs.rules[i].frequency);
+        l.gain()[i] = 0;
+    }
+}
+
+template <typename ActionSet, typename Counter>
+size_t MappedHyperCube<ActionSet, Counter>::size() const {
+    return layout_.Size();
+}
+
+template <typename ActionSet, typename Counter>
+void MappedHyperCube<ActionSet, Counter>::CreateLevel(size_t num_indif) {
+    Level l;
+    l.size_ = layout_.LevelSize(num_indif);
+    l.file_ = MappedFile(directory_ / ("hypercube_level_" + to_string(num_indif) + ".bin"), l.FileSize());
+    levels_.push_back(move(l));
+}
+
+template <typename ActionSet, typename Counter>
+void MappedHyperCube<ActionSet, Counter>::CreateTreeRec(BinaryDrag<conact>& t, BinaryDrag<conact>::node *n, size_t num_indif, uint32_t mask, size_t value) {
+    Level& l = levels_[num_indif];
+    size_t idx = layout_.Index(num_indif, mask, value);
+    if (l.actions()[idx] == 0) {
+        uint8_t p = l.max_gain_index()[idx];
+        n->data.t = conact::type::CONDITION;
+        n->data.condition = rs_.conditions[p];
+
+        uint32_t child_mask = mask & ~(1u << p);
+        size_t s = p - PopCount(mask & ((1u << p) - 1));
+        CreateTreeRec(t, n->left = t.make_node(), num_indif - 1, child_mask, InsertBit(value, s, 0));
+        CreateTreeRec(t, n->right = t.make_node(), num_indif - 1, child_mask, InsertBit(value, s, 1));
+    }
+    else {
+        n->data.t = conact::type::ACTION;
+        n->data.action = ToBitset(l.actions()[idx]);
+    }
+}
+
+template <typename ActionSet, typename Counter>
+BinaryDrag<conact> MappedHyperCube<ActionSet, Counter>::Optimize(size_t nthreads)
+{
+    if (nthreads == 0) {
+        nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    std::unique_ptr<thread_pool> pool;
+    if (nthreads > 1) {
+        pool = std::make_unique<thread_pool>(static_cast<unsigned>(nthreads * 4), nthreads);
+    }
+
+    CombineKernel<ActionSet, Counter> kernel = GetCombineKernel<ActionSet, Counter>();
+    PerformanceEvaluator level_pe;
+    for (size_t num_indif = 1; num_indif <= nbits_; num_indif++) {
+        level_pe.start();
+        CreateLevel(num_indif);
+        OptimizeLevel(layout_, num_indif, levels_[num_indif - 1].cells(), levels_[num_indif].cells(), kernel, pool.get(), nthreads);
+        // Frequencies and gains of the previous level are not required anymore
+        levels_[num_indif - 1].ReleaseCounters();
+        std::cout << num_indif << " (" << level_pe.stop() << " ms) " << std::flush;
+    }
+
+    BinaryDrag<conact> t;
+    CreateTreeRec(t, t.make_root(), nbits_, (uint32_t)((uint64_t(1) << nbits_) - 1), 0);
+    levels_.clear();
+    // Only removes the directory if it is empty
+    std::error_code ec;
+    filesystem::remove(directory_, ec);
+    return t;
+}
+
+template class MappedHyperCube<uint16_t, uint32_t>;
+template class MappedHyperCube<uint16_t, uint64_t>;
+template class MappedHyperCube<uint32_t, uint32_t>;
+template class MappedHyperCube<uint32_t, uint64_t>;
+template class MappedHyperCube<uint64_t, uint32_t>;
+template class MappedHyperCube<uint64_t, uint64_t>;
+template class MappedHyperCube<std::bitset<131>, uint32_t>;
+template class MappedHyperCube<std::bitset<131>, uint64_t>;
+
+}
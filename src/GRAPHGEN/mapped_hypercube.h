@@ -0,0 +1,97 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_MAPPED_HYPERCUBE_H_
+#define GRAPHGEN_MAPPED_HYPERCUBE_H_
+
+#include <bitset>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "conact_tree.h"
+#include "hypercube_level.h"
+#include "mapped_file.h"
+#include "pool.h"
+#include "rule_set.h"
+
+namespace hyper {
+
+/** @brief Out-of-core version of the HyperCube, whose levels are stored in memory-mapped files.
+
+The nodes of the hypercube are stored with the same level-ordered layout of HyperCube (see
+LevelLayout), but each level is stored in its own file in the specified directory.
+
+Level k is computed reading level k-1 only: both are sequentially scanned, so the operating
+system can keep in memory just the pages which are currently in use. When level k is completed,
+frequencies and gains of level k-1 are dropped from its file, keeping only what is required to
+build the final tree (actions and best condition). In this way the RAM usage is bounded by the
+page cache, while the disk must store about 3^n * (sizeof(ActionSet) + 1) bytes, plus the
+counters of two consecutive levels. Files are removed when the object is destroyed.
+
+Levels are optimized by the same code of HyperCube (see hyper::OptimizeLevel()), with the
+vectorized kernels of hypercube_kernel.h selected at runtime according to the CPU.
+
+The generated tree is the same as the one generated by HyperCube<ActionSet, Counter>.
+*/
+template <typename ActionSet, typename Counter>
+class MappedHyperCube {
+    struct Level {
+        size_t size_;
+        MappedFile file_;
+
+        size_t size() const { return size_; }
+
+        // Nodes of a level are stored as a structure of arrays: actions, best conditions,
+        // frequencies and gains. The last two are placed at the end, so they can be released
+        // truncating the file.
+        size_t ActionsOffset() const { return 0; }
+        size_t MaxGainIndexOffset() const { return size() * sizeof(ActionSet); }
+        size_t FrequencyOffset() const {
+            size_t offset = MaxGainIndexOffset() + size() * sizeof(uint8_t);
+            return (offset + alignof(Counter) - 1) / alignof(Counter) * alignof(Counter);
+        }
+        size_t GainOffset() const { return FrequencyOffset() + size() * sizeof(Counter); }
+        size_t FileSize() const { return GainOffset() + size() * sizeof(Counter); }
+
+        ActionSet* actions() { return file_.as<ActionSet>(ActionsOffset()); }
+        uint8_t* max_gain_index() { return file_.as<uint8_t>(MaxGainIndexOffset()); }
+        Counter* frequency() { return file_.as<Counter>(FrequencyOffset()); }
+        Counter* gain() { return file_.as<Counter>(GainOffset()); }
+        LevelCells<ActionSet, Counter> cells() { return { actions(), max_gain_index(), frequency(), gain() }; }
+
+        /** @brief Removes frequencies and gains from the file */
+        void ReleaseCounters() { file_.Resize(FrequencyOffset()); }
+    };
+
+    size_t nbits_;
+    const rule_set& rs_;
+    std::filesystem::path directory_;
+    LevelLayout layout_;
+    std::vector<Level> levels_;
+
+    void CreateLevel(size_t num_indif);
+    void CreateTreeRec(BinaryDrag<conact>& t, BinaryDrag<conact>::node *n, size_t num_indif, uint32_t mask, size_t value);
+
+public:
+    /** @brief Creates the hypercube of the given rule set, storing its levels in directory */
+    MappedHyperCube(const rule_set& rs, const std::filesystem::path& directory);
+
+    /** @brief Returns the number of nodes of the hypercube */
+    size_t size() const;
+
+    /** @brief Returns the number of bytes required to store a node of the hypercube on disk */
+    static constexpr size_t NodeSize() {
+        return sizeof(ActionSet) + 2 * sizeof(Counter) + sizeof(uint8_t);
+    }
+
+    /** @brief Optimizes the hypercube and returns the corresponding decision tree, see HyperCube::Optimize() */
+    BinaryDrag<conact> Optimize(size_t nthreads = 1);
+};
+
+}
+
+#endif // !GRAPHGEN_MAPPED_HYPERCUBE_H_
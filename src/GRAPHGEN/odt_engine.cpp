@@ -0,0 +1,164 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "odt_engine.h"
+
+#include <filesystem>
+#include <iostream>
+
+#include "conact_drag_file.h"
+#include "config_data.h"
+#include "hypercube.h"
+#include "hypercube++.h"
+#include "utilities.h"
+
+using namespace std;
+
+class LegacyOdtEngine : public OdtEngine {
+public:
+    BinaryDrag<conact> Generate(const rule_set& rs) override {
+        TLOG("Allocating hypercube",
+            VHyperCube hcube(rs);
+        );
+
+        TLOG("Optimizing rules",
+            auto t = hcube.optimize(false);
+        );
+
+        return t;
+    }
+};
+
+class IndexOdtEngine : public OdtEngine {
+    size_t nthreads_;
+public:
+    IndexOdtEngine(size_t nthreads) : nthreads_{ nthreads } {}
+
+    BinaryDrag<conact> Generate(const rule_set& rs) override {
+        return hyper::GenerateOdt(rs, nthreads_);
+    }
+};
+
+class OutOfCoreOdtEngine : public OdtEngine {
+    filesystem::path directory_;
+    size_t nthreads_;
+public:
+    OutOfCoreOdtEngine(filesystem::path directory, size_t nthreads) : directory_{ move(directory) }, nthreads_{ nthreads } {}
+
+    BinaryDrag<conact> Generate(const rule_set& rs) override {
+        return hyper::GenerateOdtOutOfCore(rs, directory_, nthreads_);
+    }
+};
+
+OdtEngineRegistry::OdtEngineRegistry() {
+    Register("legacy", "string-based hypercube", [] {
+        return make_unique<LegacyOdtEngine>();
+    });
+    Register("index", "in-core index-based hypercube", [] {
+        return make_unique<IndexOdtEngine>(conf.hypercube_threads_);
+    });
+    Register("out_of_core", "index-based hypercube with levels in memory-mapped files", [] {
+        return make_unique<OutOfCoreOdtEngine>(conf.hypercube_path_, conf.hypercube_threads_);
+    });
+}
+
+OdtEngineRegistry& OdtEngineRegistry::Instance() {
+    static OdtEngineRegistry registry;
+    return registry;
+}
+
+void OdtEngineRegistry::Register(const string& name, const string& description, Factory factory) {
+    engines_[name] = { description, move(factory) };
+}
+
+unique_ptr<OdtEngine> OdtEngineRegistry::Create(const string& name) const {
+    auto it = engines_.find(name);
+    if (it == engines_.end()) {
+        return nullptr;
+    }
+    return it->second.factory();
+}
+
+vector<string> OdtEngineRegistry::Names() const {
+    vector<string> names;
+    for (const auto& e : engines_) {
+        names.push_back(e.first);
+    }
+    return names;
+}
+
+string OdtEngineRegistry::Description(const string& name) const {
+    auto it = engines_.find(name);
+    return it == engines_.end() ? "" : it->second.description;
+}
+
+BinaryDrag<conact> GenerateOdt(const rule_set& rs) {
+    auto engine = OdtEngineRegistry::Instance().Create(conf.odt_engine_);
+    if (!engine) {
+        cout << "WARNING: unknown ODT engine '" << conf.odt_engine_ << "', 'index' will be used.\n";
+        engine = OdtEngineRegistry::Instance().Create("index");
+    }
+    return engine->Generate(rs);
+}
+
+BinaryDrag<conact> GenerateOdt(const rule_set& rs, const string& filename)
+{
+    auto t = GenerateOdt(rs);
+    WriteConactTree(t, filename);
+    return t;
+}
+
+// Stores the tree in the ODT cache. The tree is written to a temporary file which is then renamed,
+// so that concurrent executions sharing the cache never read a partially written entry.
+static void StoreOdtInCache(const BinaryDrag<conact>& t, const filesystem::path& cache_filename) {
+    error_code ec;
+    filesystem::create_directories(cache_filename.parent_path(), ec);
+    filesystem::path tmp_filename = cache_filename;
+    tmp_filename += "." + conf.algorithm_name_ + ".tmp";
+    if (ec || !WriteConactDragBinary(t, tmp_filename.string())) {
+        cout << "WARNING: unable to store the ODT in cache '" << cache_filename.string() << "'.\n";
+        return;
+    }
+    filesystem::rename(tmp_filename, cache_filename, ec);
+    if (ec) {
+        cout << "WARNING: unable to store the ODT in cache '" << cache_filename.string() << "'.\n";
+        filesystem::remove(tmp_filename, ec);
+    }
+}
+
+static BinaryDrag<conact> GetOdtFromFile(const rule_set& rs, const string& odt_filename, bool force_generation) {
+    BinaryDrag<conact> t;
+    force_generation = force_generation || conf.force_odt_generation_;
+
+    if (!conf.odt_cache_) {
+        if (force_generation || !LoadConactTree(t, odt_filename)) {
+            t = GenerateOdt(rs, odt_filename);
+        }
+        return t;
+    }
+
+    // The cache entry is identified by the hash of the rule set, so a modified rule set (actions,
+    // frequencies, pixel set, ...) never reuses a stale tree, while algorithms with the same rule
+    // set share the same entry. Entries are stored in the binary DRAG format, which is faster to
+    // load than the text one. The tree is copied in the algorithm output folder anyway.
+    filesystem::path cache_filename = conf.GetOdtCachePath(rs.Hash());
+    if (!force_generation && LoadConactDragBinary(t, cache_filename.string())) {
+        WriteConactTree(t, odt_filename);
+        return t;
+    }
+
+    t = GenerateOdt(rs, odt_filename);
+    StoreOdtInCache(t, cache_filename);
+    return t;
+}
+
+BinaryDrag<conact> GetOdt(const rule_set& rs, bool force_generation) {
+    return GetOdtFromFile(rs, conf.odt_path_.string(), force_generation);
+}
+
+BinaryDrag<conact> GetOdtWithFileSuffix(const rule_set& rs, const string& file_suffix, bool force_generation) {
+    return GetOdtFromFile(rs, conf.GetCustomOdtPath(file_suffix).string(), force_generation);
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_ODT_ENGINE_H_
+#define GRAPHGEN_ODT_ENGINE_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "conact_tree.h"
+#include "rule_set.h"
+
+/** @brief Interface of the algorithms (engines) which generate the Optimal Decision Tree of a rule set.
+
+Engines are created by name through the OdtEngineRegistry, so the one used by GenerateOdt() and
+GetOdt() can be selected at runtime from the configuration file (hypercube: engine).
+*/
+class OdtEngine {
+public:
+    virtual ~OdtEngine() {}
+
+    /** @brief Generates the optimal decision tree associated to the given rule set */
+    virtual BinaryDrag<conact> Generate(const rule_set& rs) = 0;
+};
+
+/** @brief Collection of the available OdtEngine, identified by name.
+
+The registry is created with the built-in engines:
+- "legacy", the original string-based hypercube (VHyperCube);
+- "index", the in-core index-based hypercube (hyper::HyperCube);
+- "out_of_core", the hypercube with levels stored in memory-mapped files (hyper::MappedHyperCube).
+
+New engines can be added with Register(). Engines are created with the parameters currently
+stored in the global configuration (conf).
+*/
+class OdtEngineRegistry {
+public:
+    using Factory = std::function<std::unique_ptr<OdtEngine>()>;
+
+    /** @brief Returns the registry */
+    static OdtEngineRegistry& Instance();
+
+    /** @brief Adds an engine to the registry, replacing the one with the same name, if any */
+    void Register(const std::string& name, const std::string& description, Factory factory);
+
+    /** @brief Creates the engine with the given name. Returns nullptr if there is no such engine */
+    std::unique_ptr<OdtEngine> Create(const std::string& name) const;
+
+    /** @brief Returns the names of the registered engines */
+    std::vector<std::string> Names() const;
+
+    /** @brief Returns the description of the engine with the given name */
+    std::string Description(const std::string& name) const;
+
+private:
+    struct Entry {
+        std::string description;
+        Factory factory;
+    };
+    std::map<std::string, Entry> engines_;
+
+    OdtEngineRegistry();
+};
+
+// Generates an Optimal Decision Tree from the given rule_set with the engine
+// selected in the configuration, and store it in the filename when specified.
+BinaryDrag<conact> GenerateOdt(const rule_set& rs);
+BinaryDrag<conact> GenerateOdt(const rule_set& rs, const std::string& filename);
+
+/** @brief Returns the optimal (or pseudo optimal) decision tree generated from the given rule set
+
+This function generates the optimal decision tree from the given rule set. When the number
+of rules is too high, a pseudo optimal tree is generated. If the tree of the same rule set has already
+been generated, it is loaded from the ODT cache (see rule_set::Hash()), unless the "force_generation"
+parameter is set to true. In this case the tree is always regenerated. The loaded/generated tree is
+stored in the algorithm output folder and then returned from the function.
+
+@param[in] rs Rule set from which generate the decision tree.
+@param[in] force_generation Whether the tree must be generated or can be loaded from file.
+
+@return The optimal decision tree associated to the specified rule set.
+*/
+BinaryDrag<conact> GetOdt(const rule_set& rs, bool force_generation = false);
+
+
+/** @brief Returns the optimal (or pseudo optimal) decision tree generated from the given rule set
+
+This function generates the optimal decision tree from the given rule set. When the number
+of rules is too high, a pseudo optimal tree is generated. If the tree of the same rule set has already
+been generated, it is loaded from the ODT cache (see rule_set::Hash()), unless the "force_generation"
+parameter is set to true. In this case the tree is always regenerated. The loaded/generated tree is
+stored in the algorithm output folder and then returned from the function.
+
+@param[in] rs Rule set from which generate the decision tree.
+@param[in] file_suffix Suffix that is appended to the file name of the decision tree file.
+@param[in] force_generation Whether the tree must be generated or can be loaded from file.
+
+@return The optimal decision tree associated to the specified rule set.
+*/
+BinaryDrag<conact> GetOdtWithFileSuffix(const rule_set& rs, const std::string& file_suffix, bool force_generation = false);
+
+#endif // !GRAPHGEN_ODT_ENGINE_H_
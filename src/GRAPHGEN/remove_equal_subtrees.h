@@ -7,21 +7,28 @@
 #ifndef GRAPHGEN_REMOVE_EQUAL_SUBTREES_H_
 #define GRAPHGEN_REMOVE_EQUAL_SUBTREES_H_
 
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
 
+#include "arena_drag.h"
 #include "conact_tree.h"
 
 /** @brief This class allows to "remove" equal subtrees from a BinaryDrag.
 
 The class updates the input BinaryDrag itself so there is no need to build
 a non temporary object. Thus you can do: RemoveEqualSubtrees{bd}.
-The recursive procedure to find equal subtrees exploit memoization so it is
-quite efficient. Please note that the removal of equal subtrees is performed 
-updating the links but nodes are not actually deleted.
+Every subtree is identified by a structural id, obtained hash-consing the
+(condition, left id, right id) or (action, next) tuple of its root in an
+ArenaDrag, so each node is processed in constant time and two subtrees are
+equal if and only if they have the same id. The first subtree found with a
+given id is kept, the others are replaced by it. Please note that the removal
+of equal subtrees is performed updating the links but nodes are not actually
+deleted.
 */
 struct RemoveEqualSubtrees {
-    std::unordered_map<std::string, BinaryDrag<conact>::node*> sp_; // string -> pointer
-    std::unordered_map<BinaryDrag<conact>::node*, std::string> ps_; // pointer -> string
+    ArenaDrag ids_; // structural ids of the subtrees
+    std::unordered_map<BinaryDrag<conact>::node*, ArenaDrag::id> pi_; // pointer -> id
+    std::vector<BinaryDrag<conact>::node*> ip_; // id -> pointer
     uint nodes_ = 0, leaves_ = 0;
 
     RemoveEqualSubtrees(BinaryDrag<conact>& bd) {
@@ -30,41 +37,39 @@ struct RemoveEqualSubtrees {
         }
     }
 
-    std::string RemoveEqualSubtreesRec(BinaryDrag<conact>::node*& n)
+    // Removes equal subtrees only from the DRAG reachable from the given root
+    RemoveEqualSubtrees(BinaryDrag<conact>::node*& root) {
+        RemoveEqualSubtreesRec(root);
+    }
+
+    ArenaDrag::id RemoveEqualSubtreesRec(BinaryDrag<conact>::node*& n)
     {
         // Did we already find this node?
-        auto itps = ps_.find(n);
-        if (itps != end(ps_)) {
-            // Yes, return the string
-            return itps->second;
+        auto itpi = pi_.find(n);
+        if (itpi != end(pi_)) {
+            // Yes, return its id
+            return itpi->second;
         }
 
-        std::string s;
+        ArenaDrag::id id;
         if (n->isleaf()) {
             ++leaves_;
-            //ss << setfill('0') << setw(3) << n->data.next;
-            //s = n->data.action.to_string() + ss.str();
-            const std::vector<uint>& a = n->data.actions();
-            s = '.' + std::to_string(a[0]);
-            for (std::size_t i = 1; i < a.size(); ++i) {
-                s += ',' + std::to_string(a[i]);
-            }
-            s += '-' + std::to_string(n->data.next);
+            id = ids_.MakeLeaf(n->data.action, n->data.next);
         }
         else {
             ++nodes_;
-            auto sl = RemoveEqualSubtreesRec(n->left);
-            auto sr = RemoveEqualSubtreesRec(n->right);
-            s = n->data.condition + sl + sr;
+            auto il = RemoveEqualSubtreesRec(n->left);
+            auto ir = RemoveEqualSubtreesRec(n->right);
+            id = ids_.MakeNode(n->data.condition, il, ir);
         }
 
-        auto it = sp_.find(s);
-        if (it == end(sp_)) {
-            sp_.insert({ s, n });
-            ps_.insert({ n, s });
+        if (id == ip_.size()) {
+            // New id: n is the first subtree of its kind
+            ip_.push_back(n);
+            pi_.insert({ n, id });
         }
         else {
-            n = it->second;
+            n = ip_[id];
             if (n->isleaf()) {
                 --leaves_;
             }
@@ -72,7 +77,7 @@ struct RemoveEqualSubtrees {
                 --nodes_;
             }
         }
-        return s;
+        return id;
     }
 };
 
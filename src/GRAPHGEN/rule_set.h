@@ -30,6 +30,7 @@
 #define GRAPHGEN_RULE_SET_H_
 
 #include <bitset>
+#include <cstdint>
 #include <fstream>
 #include <iterator>
 #include <ostream>
@@ -223,6 +224,66 @@ struct rule_set {
 
     }
 
+    /** @brief Returns a 64-bit hash of the rule set which identifies its optimal decision tree.
+
+    The hash covers conditions, actions, the actions and frequency of every rule and the pixel set
+    (pixels and shifts). It is computed with FNV-1a on a fixed byte representation of the data, so
+    it is stable across executions, compilers and platforms, and can be used as a persistent key.
+    */
+    uint64_t Hash() const {
+        uint64_t h = 14695981039346656037ull;
+        auto bytes = [&h](const void* data, size_t size) {
+            auto p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                h = (h ^ p[i]) * 1099511628211ull;
+            }
+        };
+        auto number = [&bytes](uint64_t v) {
+            unsigned char b[8];
+            for (int i = 0; i < 8; ++i) {
+                b[i] = static_cast<unsigned char>(v >> (8 * i));
+            }
+            bytes(b, 8);
+        };
+        auto str = [&](const std::string& s) {
+            number(s.size());
+            bytes(s.data(), s.size());
+        };
+
+        number(conditions.size());
+        for (const auto& c : conditions) {
+            str(c);
+        }
+        number(actions.size());
+        for (const auto& a : actions) {
+            str(a);
+        }
+        number(rules.size());
+        for (const auto& r : rules) {
+            number(r.frequency);
+            for (size_t j = 0; j < r.actions.size(); j += 64) {
+                uint64_t word = 0;
+                for (size_t k = 0; k < 64 && j + k < r.actions.size(); ++k) {
+                    word |= uint64_t(r.actions[j + k]) << k;
+                }
+                number(word);
+            }
+        }
+        number(ps_.pixels_.size());
+        for (const auto& p : ps_.pixels_) {
+            str(p.name_);
+            number(p.coords_.size());
+            for (const auto& c : p.coords_) {
+                number(static_cast<uint64_t>(static_cast<int64_t>(c)));
+            }
+        }
+        number(ps_.shifts_.size());
+        for (const auto& s : ps_.shifts_) {
+            number(s);
+        }
+        return h;
+    }
+
 };
 
 struct rule_wrapper {
@@ -0,0 +1,122 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "transposition_table.h"
+
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+// Two independent 64-bit hashes, updated together
+struct Hasher {
+    uint64_t h1 = 14695981039346656037ull;
+    uint64_t h2 = 0x9e3779b97f4a7c15ull;
+
+    static uint64_t Mix(uint64_t h) {
+        // Finalizer of MurmurHash3
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void number(uint64_t v) {
+        h1 = (h1 ^ v) * 1099511628211ull;
+        h2 = Mix(h2 + v);
+    }
+
+    void str(const string& s) {
+        number(s.size());
+        for (unsigned char c : s) {
+            h1 = (h1 ^ c) * 1099511628211ull;
+            h2 = (h2 ^ c) * 0x100000001b3ull + 0x2545f4914f6cdd1dull;
+        }
+    }
+};
+
+}
+
+TranspositionTable::Key TranspositionTable::DragKey(const BinaryDrag<conact>& bd) {
+    // Nodes are numbered in visit order and shared nodes are hashed as references to their number, so
+    // the key identifies the DRAG and not only the trees it represents: a DRAG which is not reduced
+    // (with equal subtrees not merged) has a different key from the reduced one
+    Hasher h;
+    unordered_map<const BinaryDrag<conact>::node*, size_t> ids;
+    function<void(const BinaryDrag<conact>::node*)> KeyRec = [&](const BinaryDrag<conact>::node* n) {
+        auto it = ids.find(n);
+        if (it != ids.end()) {
+            h.number(0);
+            h.number(it->second);
+            return;
+        }
+        ids.emplace(n, ids.size());
+        if (n->isleaf()) {
+            h.number(1);
+            h.number(n->data.next);
+            for (size_t b = 0; b < n->data.action.size(); ++b) {
+                if (n->data.action[b]) {
+                    h.number(b);
+                }
+            }
+            h.number(n->data.action.size());
+        }
+        else {
+            h.number(2);
+            h.str(n->data.condition);
+            KeyRec(n->left);
+            KeyRec(n->right);
+        }
+    };
+
+    h.number(bd.roots_.size());
+    for (const auto& r : bd.roots_) {
+        KeyRec(r);
+    }
+    return Key{ Hasher::Mix(h.h1), Hasher::Mix(h.h2) };
+}
+
+bool TranspositionTable::Visited(const Key& k, const vector<uint32_t>& path) {
+    if (max_bytes_ == 0) {
+        return false;
+    }
+
+    Shard& s = shards_[k.h2 % kShards];
+    lock_guard<mutex> lock(s.m);
+    auto it = s.states.find(k);
+    if (it != s.states.end()) {
+        if (it->second <= path) {
+            ++hits_;
+            return true;
+        }
+        // Reached from an earlier path: it must be explored again, from here
+        it->second = path;
+        ++misses_;
+        return false;
+    }
+
+    ++misses_;
+    // Approximate size of the entry, including the node of the hash table and its bucket
+    size_t entry_bytes = sizeof(pair<const Key, vector<uint32_t>>) + path.size() * sizeof(uint32_t) + 2 * sizeof(void*);
+    if (bytes_ + entry_bytes <= max_bytes_) {
+        bytes_ += entry_bytes;
+        s.states.emplace(k, path);
+    }
+    return false;
+}
+
+void TranspositionTable::Clear() {
+    for (auto& s : shards_) {
+        lock_guard<mutex> lock(s.m);
+        s.states.clear();
+    }
+    bytes_ = 0;
+    hits_ = 0;
+    misses_ = 0;
+}
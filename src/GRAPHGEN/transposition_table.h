@@ -0,0 +1,76 @@
+// Copyright (c) 2020, the GRAPHGEN contributors, as
+// shown by the AUTHORS file. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef GRAPHGEN_TRANSPOSITION_TABLE_H_
+#define GRAPHGEN_TRANSPOSITION_TABLE_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "condition_action.h"
+#include "drag.h"
+
+/** @brief Set of the DRAGs already explored by a search (see DragCompressor).
+
+DRAGs are identified by a 128-bit structural hash of all their roots (see DragKey()), which includes the
+shared nodes but does not depend on their addresses, so different sequences of merges which reach the
+same DRAG give the same key.
+Together with the key, the table stores the path of the search (the index of the merge chosen at each
+level) from which the DRAG has been first reached: a DRAG is reported as already explored only if it has
+been reached from a path which precedes the current one in depth-first order. In this way the table can
+be shared by the threads of a parallel search without changing its result. The serial search always
+passes an empty path.
+
+The table is thread-safe and its memory is bounded: once the cap is reached, new DRAGs are not recorded
+anymore (and are thus always explored).
+*/
+class TranspositionTable {
+public:
+    struct Key {
+        uint64_t h1, h2;
+        bool operator==(const Key& rhs) const { return h1 == rhs.h1 && h2 == rhs.h2; }
+    };
+
+    /** @brief Creates a table using at most (approximately) max_bytes bytes. A cap of 0 disables the table */
+    TranspositionTable(size_t max_bytes = 0) : max_bytes_{ max_bytes } {}
+
+    /** @brief Computes the structural hash of a DRAG */
+    static Key DragKey(const BinaryDrag<conact>& bd);
+
+    /** @brief Returns whether the DRAG with the given key has already been explored from a path which
+    precedes (or is equal to) the given one. If not, the DRAG is recorded as explored from path.
+    */
+    bool Visited(const Key& k, const std::vector<uint32_t>& path = {});
+
+    /** @brief Removes all the DRAGs from the table and resets the counters */
+    void Clear();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t bytes() const { return bytes_; }
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& k) const { return static_cast<size_t>(k.h1); }
+    };
+    struct Shard {
+        std::mutex m;
+        std::unordered_map<Key, std::vector<uint32_t>, KeyHash> states;
+    };
+    static constexpr size_t kShards = 64;
+
+    std::array<Shard, kShards> shards_;
+    size_t max_bytes_;
+    std::atomic<size_t> bytes_ = 0;
+    std::atomic<size_t> hits_ = 0;
+    std::atomic<size_t> misses_ = 0;
+};
+
+#endif // !GRAPHGEN_TRANSPOSITION_TABLE_H_
@@ -20,7 +20,7 @@ int main()
 
     // Call GRAPHGEN:
     // 1) Load or generate Optimal Decision Tree based on Grana mask
-    BinaryDrag<conact> bd = hyper::GetOdt(rs);
+    BinaryDrag<conact> bd = GetOdt(rs);
 
     // 2) Draw the generated tree
     string tree_filename = algorithm_name + "_tree";